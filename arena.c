@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+
+// The arena owns the memory between the end of the program and the screen
+// memory. Allocations are taken from the bottom, one after the other, and
+// are freed all at once by going back to a mark. There is no fragmentation
+// and the cost of an allocation is a few additions.
+
+// The arena state
+static struct {
+    unsigned char *start;       // First byte of the arena
+    unsigned char *end;         // Byte following the arena
+    unsigned char *next;        // Next free byte
+    unsigned char *high_water;  // Highest value next has reached
+} arena = { NULL, NULL, NULL, NULL };
+
+// Returns the address following the program code and data, given by the
+// linker.
+unsigned char *program_end() {
+#asm
+    EXTERN __tail
+    ld hl, __tail
+    ret
+#endasm
+}
+
+// Give the arena the memory between start and end.
+void arena_init(unsigned char *start, unsigned char *end) {
+    arena.start = start;
+    arena.end = end;
+    arena.next = start;
+    arena.high_water = start;
+}
+
+// Allocate size bytes whose address is a multiple of alignment, which must be
+// a power of 2 (512 for a roller RAM, 256 for a lookup table indexed by L).
+// Returns NULL if there is not enough memory left.
+void *arena_alloc_aligned(unsigned int size, unsigned int alignment) {
+    unsigned char *block;
+
+    block = (unsigned char *)
+        (((unsigned int)arena.next + alignment - 1) & ~(alignment - 1));
+
+    if(block < arena.next || (unsigned int)(arena.end - block) < size) {
+        return NULL;
+    }
+
+    arena.next = block + size;
+    if(arena.next > arena.high_water) arena.high_water = arena.next;
+
+    return block;
+}
+
+// Allocate size bytes. Returns NULL if there is not enough memory left.
+void *arena_alloc(unsigned int size) {
+    return arena_alloc_aligned(size, 1);
+}
+
+// Returns a mark to which arena_release() can go back.
+unsigned char *arena_mark() {
+    return arena.next;
+}
+
+// Free every allocation made since a mark was taken.
+void arena_release(unsigned char *mark) {
+    arena.next = mark;
+}
+
+// Returns the number of bytes left in the arena.
+unsigned int arena_available() {
+    return arena.end - arena.next;
+}
+
+// Returns the highest number of bytes ever used in the arena.
+unsigned int arena_high_water() {
+    return arena.high_water - arena.start;
+}
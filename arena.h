@@ -0,0 +1,13 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+extern unsigned char *program_end();
+extern void arena_init(unsigned char *start, unsigned char *end);
+extern void *arena_alloc(unsigned int size);
+extern void *arena_alloc_aligned(unsigned int size, unsigned int alignment);
+extern unsigned char *arena_mark();
+extern void arena_release(unsigned char *mark);
+extern unsigned int arena_available();
+extern unsigned int arena_high_water();
+
+#endif
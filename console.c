@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "videoram.h"
+#include "arena.h"
+#include "console.h"
+
+// The console keeps every line printed as text in a history ring buffer, so
+// pages of past lines are drawn again by print() rather than kept as pixels.
+// A line is stored as its attributes with bit 7 set, its characters, then
+// '\0': about 40 bytes for a typical log line instead of 720 for its row of
+// cells. The attributes byte is never 0, so the start of a line is found
+// going backwards by looking for the '\0' of the previous one. Lines are not
+// split at the end of the buffer: when a line does not fit there, the buffer
+// ends at wrap_end and the line is written at the start. The oldest lines are
+// dropped to make room.
+//
+// The line being printed is kept in current until it ends with '\n' or fills
+// the width of the window. It is always the last line, shown on the bottom
+// row of the window.
+
+#define LINE_START 0x80
+
+// Console state
+static struct {
+    unsigned char *buffer;         // History ring buffer
+    unsigned int size;             // Size of buffer
+    unsigned int head;             // Where the next line is stored
+    unsigned int tail;             // Oldest line
+    unsigned int newest;           // Last line stored
+    unsigned int wrap_end;         // End of the lines before a wrap, else size
+    unsigned int lines;            // Number of lines stored
+    unsigned int back;             // Lines the view is scrolled back, 0 if live
+    unsigned char top;             // First row of the window
+    unsigned char rows;            // Rows of the window
+    unsigned char attributes;      // Attributes of the next line
+    unsigned char length;          // Characters in current
+    unsigned char drawn;           // Characters of current on the screen
+    unsigned char line_attributes; // Attributes of the line in current
+    unsigned char columns;         // Width of the lines, in cells
+} console;
+
+// Line being printed
+static unsigned char current[CONSOLE_COLUMNS + 1];
+
+// Clear count rows of the window from row, on the drawing target.
+static void clear_rows(unsigned char row, unsigned char count) {
+    memset(cell_address(0, row), 0, count * get_target()->stride);
+}
+
+// Take a history buffer of history bytes from the arena and use rows of the
+// drawing target from top as the console window, cleared. Lines are as wide
+// as the target, up to CONSOLE_COLUMNS.
+// Returns 0 if there is not enough memory, 1 otherwise.
+unsigned char init_console(unsigned int history, unsigned char top, unsigned char rows) {
+    memset(&console, 0, sizeof(console));
+    if(history < CONSOLE_COLUMNS + 2 || rows == 0) return 0;
+
+    console.buffer = arena_alloc(history);
+    if(console.buffer == NULL) return 0;
+
+    console.size = history;
+    console.wrap_end = history;
+    console.top = top;
+    console.rows = rows;
+    console.columns = get_target()->columns;
+    if(console.columns > CONSOLE_COLUMNS) console.columns = CONSOLE_COLUMNS;
+    clear_rows(top, rows);
+
+    return 1;
+}
+
+// Set the attributes (see set_attributes()) of the lines printed next. A
+// line takes the attributes set when its first character is printed.
+void console_attributes(unsigned char attributes) {
+    console.attributes = attributes;
+}
+
+// Returns the position of the line following the one at position.
+static unsigned int next_line(unsigned int position) {
+    while(console.buffer[position] != '\0') position++;
+    position++;
+
+    return position == console.wrap_end ? 0 : position;
+}
+
+// Returns the position of the line preceding the one at position, which must
+// not be the oldest.
+static unsigned int previous_line(unsigned int position) {
+    if(position == 0) position = console.wrap_end;
+    position--;
+
+    while(position != console.tail && position != 0
+          && console.buffer[position - 1] != '\0') {
+        position--;
+    }
+
+    return position;
+}
+
+// Drop the oldest line of the history.
+static void drop_oldest() {
+    console.tail = next_line(console.tail);
+    if(console.tail == 0) console.wrap_end = console.size;
+    console.lines--;
+}
+
+// Store the line being printed in the history, dropping the oldest lines to make room.
+static void store_line() {
+    unsigned int size;
+
+    size = console.length + 2;
+    for(;;) {
+        if(console.lines == 0) {
+            console.head = 0;
+            console.tail = 0;
+            console.wrap_end = console.size;
+        }
+
+        if(console.lines != 0 && console.tail >= console.head) {
+            // The free space is between head and tail
+            if(console.head + size <= console.tail) break;
+            drop_oldest();
+        } else {
+            // The free space is after head, then before tail
+            if(console.head + size <= console.size) break;
+            console.wrap_end = console.head;
+            console.head = 0;
+        }
+    }
+
+    console.newest = console.head;
+    console.buffer[console.head] = console.line_attributes | LINE_START;
+    memcpy(console.buffer + console.head + 1, current, console.length + 1);
+    console.head += size;
+    console.lines++;
+}
+
+// Returns how many lines the view can be scrolled back, the oldest line
+// being then on the top row.
+static unsigned int max_back() {
+    if(console.lines < console.rows - 1) return 0;
+    return console.lines - (console.rows - 1);
+}
+
+// Print the characters of the line being printed not on the screen yet, when the view is live.
+static void draw_line() {
+    unsigned char attributes;
+
+    current[console.length] = '\0';
+    if(console.back != 0 || console.drawn == console.length) return;
+
+    attributes = get_attributes();
+    locate(console.drawn, console.top + console.rows - 1);
+    set_attributes(console.line_attributes);
+    print(current + console.drawn);
+    set_attributes(attributes);
+    console.drawn = console.length;
+}
+
+// Draw the window, the line on the bottom row being back lines before the
+// line being printed. Lines are taken from the history walking from the
+// nearest of the oldest and the newest line.
+static void draw_window() {
+    unsigned int bottom;
+    unsigned int first;
+    unsigned int index;
+    unsigned int position;
+    unsigned char row;
+    unsigned char attributes;
+
+    attributes = get_attributes();
+
+    // Index of the line shown on the bottom row, the line being printed
+    // having the index lines. Rows above the oldest line stay blank.
+    bottom = console.lines - console.back;
+    if(bottom >= console.rows - 1) {
+        first = bottom - (console.rows - 1);
+        row = 0;
+    } else {
+        first = 0;
+        row = console.rows - 1 - bottom;
+    }
+
+    clear_rows(console.top, console.rows);
+
+    if(first < console.lines) {
+        if(first < console.lines >> 1) {
+            position = console.tail;
+            for(index = 0; index != first; index++) {
+                position = next_line(position);
+            }
+        } else {
+            position = console.newest;
+            for(index = console.lines - 1; index != first; index--) {
+                position = previous_line(position);
+            }
+        }
+    }
+
+    for(; row != console.rows && first != console.lines; row++, first++) {
+        locate(0, console.top + row);
+        set_attributes(console.buffer[position] & ~LINE_START);
+        print(console.buffer + position + 1);
+        position = next_line(position);
+    }
+
+    // The line being printed, on the bottom row when the view is live
+    if(row != console.rows && console.length != 0) {
+        locate(0, console.top + row);
+        set_attributes(console.line_attributes);
+        print(current);
+    }
+
+    set_attributes(attributes);
+    console.drawn = console.length;
+}
+
+// End the line being printed: store it and scroll the window up when the
+// view is live, or keep the view on the same lines otherwise.
+static void end_line() {
+    draw_line();
+    store_line();
+    console.length = 0;
+    console.drawn = 0;
+
+    if(console.back == 0) {
+        copy_rect(
+            0, console.top + 1, console.columns, console.rows - 1,
+            0, console.top
+        );
+        clear_rows(console.top + console.rows - 1, 1);
+    } else if(++console.back > max_back()) {
+        // Lines shown were dropped from the history
+        console.back = max_back();
+        draw_window();
+    }
+}
+
+// Print text at the end of the console, starting a new line at each '\n' or
+// when a line fills the width of the window.
+void console_print(const unsigned char *text) {
+    for(; *text != '\0'; text++) {
+        if(*text == '\n') {
+            end_line();
+            continue;
+        }
+
+        if(console.length == console.columns) end_line();
+        if(console.length == 0) console.line_attributes = console.attributes;
+        current[console.length++] = *text;
+    }
+
+    draw_line();
+}
+
+// Show the page of lines before the ones shown, stopping when the oldest
+// line is on the top row.
+void console_page_up() {
+    unsigned int back;
+
+    back = console.back + console.rows;
+    if(back > max_back()) back = max_back();
+    if(back == console.back) return;
+
+    console.back = back;
+    draw_window();
+}
+
+// Show the page of lines after the ones shown, up to the line being printed.
+void console_page_down() {
+    if(console.back == 0) return;
+
+    console.back = console.back > console.rows ? console.back - console.rows : 0;
+    draw_window();
+}
@@ -0,0 +1,14 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+// The console uses the full width of the drawing target, in normal size
+// characters, up to CONSOLE_COLUMNS
+#define CONSOLE_COLUMNS 90
+
+extern unsigned char init_console(unsigned int history, unsigned char top, unsigned char rows);
+extern void console_attributes(unsigned char attributes);
+extern void console_print(const unsigned char *text);
+extern void console_page_up();
+extern void console_page_down();
+
+#endif
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "cpmfile.h"
+
+// Copy a file name part in upper case, padded with spaces.
+static const char *copy_name_part(
+    unsigned char *part,
+    unsigned char length,
+    const char *filename
+) {
+    unsigned char i;
+
+    for(i = 0; i != length; i++) {
+        if(*filename == '\0' || *filename == '.') {
+            part[i] = ' ';
+        } else {
+            part[i] = toupper(*filename++);
+        }
+    }
+
+    // Ignore characters exceeding the part length
+    while(*filename != '\0' && *filename != '.') filename++;
+
+    return filename;
+}
+
+// Fill a File Control Block from a file name like "A:NAME.EXT".
+void fcb_set_name(struct cpm_fcb *fcb, const char *filename) {
+    memset(fcb, 0, sizeof(struct cpm_fcb));
+
+    if(filename[0] != '\0' && filename[1] == ':') {
+        fcb->drive = toupper(filename[0]) - 'A' + 1;
+        filename += 2;
+    }
+
+    filename = copy_name_part(fcb->name, 8, filename);
+    if(*filename == '.') filename++;
+    copy_name_part(fcb->type, 3, filename);
+}
+
+#ifdef __Z88DK
+#include <cpm.h>
+
+// Open an existing file. Returns 0 if the file cannot be opened, 1 otherwise.
+unsigned char fcb_open(struct cpm_fcb *fcb, const char *filename) {
+    fcb_set_name(fcb, filename);
+    return (bdos(BDOS_OPEN_FILE, fcb) & 0xff) != 0xff;
+}
+
+// Create a file, replacing any file with the same name. Returns 0 if the file
+// cannot be created, 1 otherwise.
+unsigned char fcb_create(struct cpm_fcb *fcb, const char *filename) {
+    fcb_set_name(fcb, filename);
+    bdos(BDOS_DELETE_FILE, fcb);
+    return (bdos(BDOS_MAKE_FILE, fcb) & 0xff) != 0xff;
+}
+
+// Read the next 128 bytes record of a file directly at address. Returns 0 at
+// the end of the file, 1 otherwise.
+unsigned char fcb_read(struct cpm_fcb *fcb, unsigned char *address) {
+    bdos(BDOS_SET_DMA, address);
+    return (bdos(BDOS_READ_SEQUENTIAL, fcb) & 0xff) == 0;
+}
+
+// Write the next 128 bytes record of a file directly from address. Returns 0
+// if the disc is full, 1 otherwise.
+unsigned char fcb_write(struct cpm_fcb *fcb, unsigned char *address) {
+    bdos(BDOS_SET_DMA, address);
+    return (bdos(BDOS_WRITE_SEQUENTIAL, fcb) & 0xff) == 0;
+}
+
+// Close a file.
+void fcb_close(struct cpm_fcb *fcb) {
+    bdos(BDOS_CLOSE_FILE, fcb);
+}
+#endif
@@ -0,0 +1,38 @@
+#ifndef CPMFILE_H
+#define CPMFILE_H
+
+#define RECORD_SIZE 128
+
+#define BDOS_OPEN_FILE 15
+#define BDOS_CLOSE_FILE 16
+#define BDOS_DELETE_FILE 19
+#define BDOS_READ_SEQUENTIAL 20
+#define BDOS_WRITE_SEQUENTIAL 21
+#define BDOS_MAKE_FILE 22
+#define BDOS_SET_DMA 26
+#define BDOS_GET_DPB 31
+
+// CP/M File Control Block
+struct cpm_fcb {
+    unsigned char drive;            // 0 = default drive, 1 = A:, 2 = B:...
+    unsigned char name[8];          // File name padded with spaces
+    unsigned char type[3];          // File type padded with spaces
+    unsigned char extent;           // Current extent
+    unsigned char s1;               // Reserved
+    unsigned char s2;               // Reserved, extent high bits
+    unsigned char records;          // Number of records in the extent
+    unsigned char allocation[16];   // Allocation blocks of the extent
+    unsigned char current;          // Current record in the extent
+    unsigned char random[3];        // Random record number
+};
+
+// Available on the host too, for the disc image stand-in of diskload.c
+extern void fcb_set_name(struct cpm_fcb *fcb, const char *filename);
+
+extern unsigned char fcb_open(struct cpm_fcb *fcb, const char *filename);
+extern unsigned char fcb_create(struct cpm_fcb *fcb, const char *filename);
+extern unsigned char fcb_read(struct cpm_fcb *fcb, unsigned char *address);
+extern unsigned char fcb_write(struct cpm_fcb *fcb, unsigned char *address);
+extern void fcb_close(struct cpm_fcb *fcb);
+
+#endif
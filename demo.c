@@ -3,6 +3,7 @@
 #include <strings.h>
 
 #include "videoram.h"
+#include "keyboard.h"
 
 #pragma output noprotectmsdos
 #pragma output noredir
@@ -19,6 +20,7 @@ main() {
     unsigned char j;
     unsigned int x;
     unsigned char y;
+    unsigned char row;
 
     init_video_ram(STACK_SIZE);
 
@@ -40,27 +42,16 @@ main() {
 
     // Print explanations in french
     set_size(SIZE_NORMAL);
-    locate(0, 5);
-    print("Le jeu de caract}res de");
-    locate(0, 6);
-    print("l'Amstrad  PCW  utilise");
-    locate(0, 7);
-    print("la norme ASCII  {tendue");
-    locate(0, 8);
-    print("@ 256  caract}res  mais");
-    locate(0, 9);
-    print("certains sont remplac{s");
-    locate(0, 10);
-    print("par    des   caract}res");
-    locate(0, 11);
-    print("accentu{s.");
-
-    locate(0, 13);
-    print("Le  jeu  de  caract}res");
-    locate(0, 14);
-    print("est  orient{ traitement");
-    locate(0, 15);
-    print("de texte.");
+    row = print_paragraph(
+        "Le jeu de caract}res de l'Amstrad PCW utilise la norme ASCII "
+        "{tendue @ 256 caract}res mais certains sont remplac{s par des "
+        "caract}res accentu{s.",
+        0, 5, 23, PARAGRAPH_JUSTIFY
+    );
+    print_paragraph(
+        "Le jeu de caract}res est orient{ traitement de texte.",
+        0, row + 1, 23, PARAGRAPH_JUSTIFY
+    );
 
     frame(0, 5*8, 23*8, 16*8);
 
@@ -104,10 +95,15 @@ main() {
     */
 
     // Wait for a key before returning to CP/M
-    getchar();
+    key_init();
+    key_getchar();
 
     // Restore standard screen settings
     restore_video_ram();
 
+#ifdef VIDEO_STATS
+    video_stats_print();
+#endif
+
     return 0;
 }
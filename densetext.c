@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "videoram.h"
+#include "arena.h"
+#include "densetext.h"
+
+// Dense text puts 120 characters of 6 pixels on a line. A group of 4
+// characters fills 3 screen bytes per line, each character having one of 4
+// positions in its group:
+//
+//   position 0: bits 7-2 of byte 0
+//   position 1: bits 1-0 of byte 0 and bits 7-4 of byte 1
+//   position 2: bits 3-0 of byte 1 and bits 7-6 of byte 2
+//   position 3: bits 5-0 of byte 2
+//
+// Rather than shifting each line of a character, the bytes to OR are read
+// from tables giving, for each position and each of the 64 possible lines,
+// the left and right bytes. Pre-shifting the whole font for the 4 positions
+// would take 16 KB, these tables take 512 bytes. Each screen byte is then
+// written with one AND (keeping the pixels of the neighbour) and one OR.
+
+// Screen bytes kept around a character, for each position
+static unsigned char keep_left[4] = { 0x03, 0xfc, 0xf0, 0xc0 };
+static unsigned char keep_right[4] = { 0xff, 0x0f, 0x3f, 0xff };
+
+// Dense text state. The asm code relies on the offsets.
+static struct {
+    unsigned char *font;        // 0: Dense font
+    unsigned char *shifts;      // 2: Left bytes, then right bytes 256 bytes
+                                //    further, indexed by position * 64 + line
+    unsigned char *address;     // 4: Screen byte of the next character
+    unsigned char position;     // 6: Position of the next character * 64
+    unsigned char keep_left;    // 7: Mask of the left byte
+    unsigned char keep_right;   // 8: Mask of the right byte, 0xff for none
+    unsigned char col;          // 9: Column of the next character
+    unsigned char row;          // 10: Row of the next character
+} dense;
+
+// Convert an 8 pixels wide font to a dense font. Most 8x8 glyphs use their
+// 7 left columns, the last one separating characters: the two left columns
+// and the two columns before the last one are merged.
+void make_dense_font(unsigned char *font, unsigned char *dense_font) {
+    unsigned int i;
+    unsigned char line;
+
+    for(i = 0; i != DENSE_FONT_SIZE; i++) {
+        line = font[i];
+        dense_font[i] = ((line | (line << 1)) & 0x80) >> 2    // 0 and 1
+                      | (line & 0x38) >> 1                      // 2 to 4
+                      | ((line | (line << 1)) & 0x04) >> 1      // 5 and 6
+                      | (line & 0x01);                          // 7
+    }
+}
+
+// Select the dense font and build the shift tables, taken from the arena.
+// Returns 0 if there is not enough memory, 1 otherwise.
+unsigned char init_dense_text(unsigned char *dense_font) {
+    unsigned char line;
+    unsigned char *left;
+    unsigned char *right;
+
+    dense.font = dense_font;
+    if(dense.shifts == NULL) {
+        dense.shifts = arena_alloc_aligned(512, 256);
+        if(dense.shifts == NULL) return 0;
+    }
+
+    left = dense.shifts;
+    right = dense.shifts + 256;
+    for(line = 0; line != 64; line++) {
+        left[line] = line << 2;
+        right[line] = 0;
+        left[64 + line] = line >> 4;
+        right[64 + line] = line << 4;
+        left[128 + line] = line >> 2;
+        right[128 + line] = line << 6;
+        left[192 + line] = line;
+        right[192 + line] = 0;
+    }
+
+    dense_locate(0, 0);
+    return 1;
+}
+
+// Select the position of the next character in its group.
+static void set_position(unsigned char position) {
+    dense.position = position << 6;
+    dense.keep_left = keep_left[position];
+    dense.keep_right = keep_right[position];
+}
+
+// Sets the position of the next character to be printed.
+// col=[0..119], row=[0..31]
+void dense_locate(unsigned char col, unsigned char row) {
+    unsigned char position;
+
+    dense.col = col;
+    dense.row = row;
+
+    // Byte 0, 0, 1 or 2 of the group of 3 cells
+    position = col & 3;
+    dense.address = cell_address((col >> 2) * 3 + (position * 3 >> 2), row);
+    set_position(position);
+}
+
+// Draw a character of the dense font at the cursor.
+static void dense_glyph(unsigned char *drawing) {
+/*
+    unsigned char i;
+    unsigned char line;
+    unsigned char *address;
+
+    address = dense.address;
+    for(i = 0; i != 8; i++, address++) {
+        line = dense.position + drawing[i];
+        address[0] = (address[0] & dense.keep_left) | dense.shifts[line];
+        if(dense.keep_right != 0xff) {
+            address[8] = (address[8] & dense.keep_right)
+                       | dense.shifts[256 + line];
+        }
+    }
+*/
+#asm
+    ; drawing +4
+    push ix
+    ld ix, 0
+    add ix, sp
+
+    ld l, (ix+4)
+    ld h, (ix+5)
+    push hl
+    pop ix
+
+    ; iy = dense.address, the caller's IY being saved
+    push iy
+    ld hl, (_dense+4)
+    push hl
+    pop iy
+
+    ; ix = drawing, iy = address, h = shifts page, d = position,
+    ; b = left mask, c = right mask, e = line counter
+    ld a, (_dense+3)
+    ld h, a
+    ld a, (_dense+6)
+    ld d, a
+    ld bc, (_dense+7)
+    ld a, b
+    ld b, c
+    ld c, a
+    ld e, 8
+
+    ; if(dense.keep_right != 0xff)
+    inc a
+    jr z, left_only_dg
+
+.both_dg
+    ; hl = &dense.shifts[dense.position + drawing[i]]
+    ld a, (ix+0)
+    or d
+    ld l, a
+
+    ; address[0] = (address[0] & dense.keep_left) | left
+    ld a, (iy+0)
+    and b
+    or (hl)
+    ld (iy+0), a
+
+    ; address[8] = (address[8] & dense.keep_right) | right
+    inc h
+    ld a, (iy+8)
+    and c
+    or (hl)
+    ld (iy+8), a
+    dec h
+
+    inc ix
+    inc iy
+    dec e
+    jr nz, both_dg
+
+    pop iy
+    pop ix
+    ret
+
+.left_only_dg
+    ld a, (ix+0)
+    or d
+    ld l, a
+
+    ld a, (iy+0)
+    and b
+    or (hl)
+    ld (iy+0), a
+
+    inc ix
+    inc iy
+    dec e
+    jr nz, left_only_dg
+
+    pop iy
+    pop ix
+    ret
+#endasm
+}
+
+// Print a string with the dense font. Lines wrap after column 119 and the
+// screen after row 31, as with print().
+void dense_print(const unsigned char *string) {
+    unsigned char position;
+
+    for(; *string != '\0'; string++) {
+        dense_glyph(&dense.font[*string * 8]);
+
+        if(++dense.col == DENSE_COLUMNS) {
+            if(++dense.row == DENSE_ROWS) dense.row = 0;
+            dense_locate(0, dense.row);
+            continue;
+        }
+
+        // Position 1 shares its first byte with position 0
+        position = dense.col & 3;
+        if(position != 1) dense.address += 8;
+        set_position(position);
+    }
+}
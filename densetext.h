@@ -0,0 +1,17 @@
+#ifndef DENSETEXT_H
+#define DENSETEXT_H
+
+// 6 pixels wide characters, 4 of them in 3 bytes of a line
+#define DENSE_COLUMNS 120
+#define DENSE_ROWS 32
+
+// A dense font has 8 bytes per character like a font, each holding the 6
+// pixels of a line in bits 5 (left) to 0 (right).
+#define DENSE_FONT_SIZE 2048
+
+extern void make_dense_font(unsigned char *font, unsigned char *dense_font);
+extern unsigned char init_dense_text(unsigned char *dense_font);
+extern void dense_locate(unsigned char col, unsigned char row);
+extern void dense_print(const unsigned char *string);
+
+#endif
@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpmfile.h"
+#include "diskload.h"
+
+// The loader reads files by allocation blocks, bypassing the BDOS record by
+// record reads. The directory is read to find the blocks of a file, then
+// consecutive blocks are read as runs of physical sectors, as many sectors
+// at once as the track allows.
+//
+// Under z88dk sectors are read through the BIOS (BDOS function 50). On the
+// host, a raw disc image file stands for the drive so the loader can be run
+// on Linux.
+
+// Current disc
+static struct {
+    struct dpb dpb;                 // Disc Parameter Block
+    unsigned char user;             // User number of the files
+    unsigned int sector_size;       // Physical sector size
+    unsigned int sectors_per_track; // Physical sectors per track
+    unsigned int last_track;        // Track of the last read, for seeks
+    struct disk_stats stats;        // Access counters
+} disk;
+
+// Buffer for directory sectors and for the last sector of a file.
+static unsigned char sector[SECTOR_MAX_SIZE];
+
+// Directory entry or file name being looked for.
+static struct cpm_fcb fcb;
+
+// Blocks of the file read by load_file().
+static struct disk_file loaded;
+
+// Compute sizes derived from the Disc Parameter Block.
+static void init_disk() {
+    disk.sector_size = RECORD_SIZE << disk.dpb.physical_sector_shift;
+    disk.sectors_per_track = disk.dpb.records_per_track
+                           >> disk.dpb.physical_sector_shift;
+    disk.last_track = 0xffff;
+    memset(&disk.stats, 0, sizeof(struct disk_stats));
+}
+
+#ifdef __Z88DK
+#include <cpm.h>
+
+#define BDOS_SELECT_DISK 14
+#define BDOS_USER_CODE 32
+#define BDOS_BIOS_CALL 50
+
+#define BIOS_SELDSK 9
+#define BIOS_SETTRK 10
+#define BIOS_SETSEC 11
+#define BIOS_SETDMA 12
+#define BIOS_READ 13
+#define BIOS_MULTIO 23
+#define BIOS_SETBNK 28
+
+// BIOS parameter block for BDOS function 50
+static struct {
+    unsigned char function;
+    unsigned char a;
+    unsigned int bc;
+    unsigned int de;
+    unsigned int hl;
+} bios_call;
+
+// Call a BIOS function through the BDOS.
+static unsigned int bios(unsigned char function, unsigned char a, unsigned int bc) {
+    bios_call.function = function;
+    bios_call.a = a;
+    bios_call.bc = bc;
+    bios_call.de = 1;
+    bios_call.hl = 0;
+    return bdos(BDOS_BIOS_CALL, &bios_call);
+}
+
+// Select the drive to load from (0 = A:, 1 = B:...).
+// Returns 0 if the drive cannot be selected, 1 otherwise.
+unsigned char disk_select(unsigned char drive) {
+    if(bdos(BDOS_SELECT_DISK, drive) & 0xff) return 0;
+
+    memcpy(&disk.dpb, (void *)bdos(BDOS_GET_DPB, 0), sizeof(struct dpb));
+    disk.user = bdos(BDOS_USER_CODE, 0xff);
+    bios(BIOS_SELDSK, 0, drive);
+    init_disk();
+
+    return 1;
+}
+
+// Read count consecutive physical sectors of a track. MULTIO tells the BIOS
+// the following reads are consecutive so it may transfer them in one go.
+// Returns 0 if the BIOS reports a read error, 1 otherwise.
+static unsigned char read_track_sectors(
+    unsigned int track,
+    unsigned int first,
+    unsigned char count,
+    unsigned char *address
+) {
+    bios(BIOS_SETBNK, 1, 0);
+    bios(BIOS_MULTIO, 0, count);
+    for(; count != 0; count--) {
+        bios(BIOS_SETTRK, 0, track);
+        bios(BIOS_SETSEC, 0, first++);
+        bios(BIOS_SETDMA, 0, (unsigned int)address);
+        if(bios(BIOS_READ, 0, 0) & 0xff) return 0;
+        address += disk.sector_size;
+    }
+
+    return 1;
+}
+#else
+// Raw image of the disc, tracks one after the other
+static FILE *image = NULL;
+
+// Disc Parameter Block of the PCW 3" CF2 single sided format
+const struct dpb pcw_cf2_dpb = {
+    36, 3, 7, 0, 174, 63, 0x00c0, 16, 1, 2, 3
+};
+
+// Use a raw disc image in place of a drive.
+// Returns 0 if the image cannot be opened, 1 otherwise.
+unsigned char disk_image(const char *path, const struct dpb *dpb) {
+    if(image != NULL) fclose(image);
+    image = fopen(path, "rb");
+    if(image == NULL) return 0;
+
+    memcpy(&disk.dpb, dpb, sizeof(struct dpb));
+    disk.user = 0;
+    init_disk();
+
+    return 1;
+}
+
+// Read count consecutive physical sectors of a track from the disc image.
+// Returns 0 if the image cannot be read, 1 otherwise.
+static unsigned char read_track_sectors(
+    unsigned int track,
+    unsigned int first,
+    unsigned char count,
+    unsigned char *address
+) {
+    size_t size;
+
+    size = (size_t)count * disk.sector_size;
+    if(fseek(
+        image,
+        ((long)track * disk.sectors_per_track + first) * disk.sector_size,
+        SEEK_SET
+    )) {
+        return 0;
+    }
+
+    // Sectors beyond the end of the image read as empty
+    memset(address, 0xe5, size);
+    if(fread(address, 1, size, image) != size) {
+        if(ferror(image)) return 0;
+        clearerr(image);
+    }
+
+    return 1;
+}
+#endif
+
+// Returns the Disc Parameter Block of the current disc.
+struct dpb *disk_dpb() {
+    return &disk.dpb;
+}
+
+// Returns the user number whose files are loaded.
+unsigned char disk_user() {
+    return disk.user;
+}
+
+// Returns the access counters of the current disc.
+struct disk_stats *disk_stats() {
+    return &disk.stats;
+}
+
+// Read count consecutive physical sectors starting at a sector of a track,
+// continuing on the following tracks when needed.
+// Returns 0 if a sector cannot be read, 1 otherwise.
+unsigned char read_sectors(
+    unsigned int track,
+    unsigned int first,
+    unsigned int count,
+    unsigned char *address
+) {
+    unsigned int run;
+
+    while(count != 0) {
+        // The run is clamped to the track before being narrowed to a byte
+        run = disk.sectors_per_track - first;
+        if(count < run) run = count;
+
+        if(track != disk.last_track) {
+            disk.stats.seeks++;
+            disk.last_track = track;
+        }
+        disk.stats.reads++;
+        disk.stats.sectors += run;
+
+        if(!read_track_sectors(track, first, (unsigned char)run, address)) {
+            return 0;
+        }
+
+        address += run * disk.sector_size;
+        count -= run;
+        first = 0;
+        track++;
+    }
+
+    return 1;
+}
+
+// Read count physical sectors starting at an absolute sector number, the
+// first sector of the disc being 0 and reserved tracks included.
+// Returns 0 if a sector cannot be read, 1 otherwise.
+static unsigned char read_absolute(
+    unsigned long first,
+    unsigned int count,
+    unsigned char *address
+) {
+    return read_sectors(
+        first / disk.sectors_per_track,
+        first % disk.sectors_per_track,
+        count,
+        address
+    );
+}
+
+// Returns the absolute sector number of the start of a block.
+static unsigned long block_sector(unsigned int block) {
+    return (unsigned long)disk.dpb.reserved_tracks * disk.sectors_per_track
+         + ((unsigned long)block << (disk.dpb.block_shift
+                                   - disk.dpb.physical_sector_shift));
+}
+
+// Find the allocation blocks of a file by reading the directory entries of
+// each of its extents. Returns 0 if the file is not found, 1 if it is found,
+// DISK_READ_ERROR if the directory cannot be read.
+unsigned char find_file(const char *filename, struct disk_file *file) {
+    unsigned int entry;
+    unsigned int extent;
+    unsigned int records;
+    unsigned int index;
+    unsigned char per_entry;
+    unsigned char i;
+    unsigned char found;
+    unsigned char *directory;
+    unsigned long first;
+
+    fcb_set_name(&fcb, filename);
+    memset(file, 0, sizeof(struct disk_file));
+
+    // Blocks are stored as 16 bytes or 8 words, depending on the disc size
+    per_entry = disk.dpb.nb_disk_blocks < 256 ? 16 : 8;
+
+    found = 0;
+    first = (unsigned long)disk.dpb.reserved_tracks * disk.sectors_per_track;
+    directory = sector + disk.sector_size;
+    for(entry = 0; entry <= disk.dpb.nb_directory_entries; entry++) {
+        if(directory == sector + disk.sector_size) {
+            if(!read_absolute(first++, 1, sector)) return DISK_READ_ERROR;
+            directory = sector;
+        }
+
+        if(directory[0] == disk.user) {
+            // Compare name and type, ignoring their attribute bits
+            for(i = 1; i != 12; i++) {
+                if((directory[i] & 0x7f) != ((unsigned char *)&fcb)[i]) break;
+            }
+
+            if(i == 12) {
+                found = 1;
+
+                // The entry holds extent_mask + 1 logical extents of 16k
+                extent = directory[12] + (directory[14] << 5);
+                records = extent * 128 + directory[15];
+                if(records > file->records) file->records = records;
+
+                index = (extent / (disk.dpb.extent_mask + 1)) * per_entry;
+                for(i = 0; i != per_entry && index < MAX_FILE_BLOCKS; i++) {
+                    if(per_entry == 16) {
+                        file->blocks[index++] = directory[16 + i];
+                    } else {
+                        file->blocks[index++] = directory[16 + i * 2]
+                                              + (directory[17 + i * 2] << 8);
+                    }
+                }
+            }
+        }
+
+        directory += 32;
+    }
+
+    index = (file->records + disk.dpb.block_mask) >> disk.dpb.block_shift;
+    file->block_count = index > MAX_FILE_BLOCKS ? MAX_FILE_BLOCKS : index;
+
+    return found;
+}
+
+// Load the blocks of a file found by find_file() at address, without loading
+// more than size bytes. Consecutive blocks are read in a single run of
+// sectors. Returns the number of bytes loaded, DISK_LOAD_ERROR if a sector
+// cannot be read.
+unsigned int load_blocks(
+    struct disk_file *file,
+    unsigned char *address,
+    unsigned int size
+) {
+    unsigned int left;
+    unsigned int records;
+    unsigned int loaded_records;
+    unsigned int whole;
+    unsigned char block;
+    unsigned char last;
+    unsigned char shift;
+    unsigned long start;
+
+    shift = disk.dpb.physical_sector_shift;
+    left = file->records;
+    if(size / RECORD_SIZE < left) left = size / RECORD_SIZE;
+
+    loaded_records = 0;
+    for(block = 0; left != 0 && block != file->block_count; block = last) {
+        // Group consecutive blocks
+        for(last = block + 1; last != file->block_count; last++) {
+            if(file->blocks[last] != file->blocks[last - 1] + 1) break;
+        }
+
+        records = (unsigned int)(last - block) << disk.dpb.block_shift;
+        if(records > left) records = left;
+
+        // Whole sectors go directly to their destination
+        start = block_sector(file->blocks[block]);
+        whole = records >> shift;
+        if(whole != 0 && !read_absolute(start, whole, address)) {
+            return DISK_LOAD_ERROR;
+        }
+        address += whole * disk.sector_size;
+
+        // A partial last sector goes through the sector buffer
+        if(records & disk.dpb.physical_sector_mask) {
+            if(!read_absolute(start + whole, 1, sector)) return DISK_LOAD_ERROR;
+            memcpy(
+                address,
+                sector,
+                (records & disk.dpb.physical_sector_mask) * RECORD_SIZE
+            );
+            address += (records & disk.dpb.physical_sector_mask) * RECORD_SIZE;
+        }
+
+        left -= records;
+        loaded_records += records;
+    }
+
+    return loaded_records * RECORD_SIZE;
+}
+
+// Read count records of a file found by find_file(), starting at a record,
+// as a program reading records at random would. Whole sectors go directly to
+// their destination, partial ones through the sector buffer.
+// Returns 0 if a sector cannot be read, 1 otherwise.
+unsigned char read_file_records(
+    struct disk_file *file,
+    unsigned int record,
+    unsigned int count,
+    unsigned char *address
+) {
+    unsigned int block;
+    unsigned int in_block;
+    unsigned int records;
+    unsigned int offset;
+    unsigned int part;
+    unsigned long first;
+
+    while(count != 0 && (record >> disk.dpb.block_shift) < file->block_count) {
+        block = record >> disk.dpb.block_shift;
+        in_block = record & disk.dpb.block_mask;
+        records = disk.dpb.block_mask + 1 - in_block;
+        if(records > count) records = count;
+
+        first = block_sector(file->blocks[block])
+              + (in_block >> disk.dpb.physical_sector_shift);
+        offset = in_block & disk.dpb.physical_sector_mask;
+
+        record += records;
+        count -= records;
+        while(records != 0) {
+            if(offset == 0 && records > disk.dpb.physical_sector_mask) {
+                // Whole sectors
+                part = records & ~disk.dpb.physical_sector_mask;
+                if(!read_absolute(
+                    first,
+                    part >> disk.dpb.physical_sector_shift,
+                    address
+                )) {
+                    return 0;
+                }
+                first += part >> disk.dpb.physical_sector_shift;
+            } else {
+                // Part of a sector
+                part = disk.dpb.physical_sector_mask + 1 - offset;
+                if(part > records) part = records;
+                if(!read_absolute(first++, 1, sector)) return 0;
+                memcpy(address, sector + offset * RECORD_SIZE, part * RECORD_SIZE);
+                offset = 0;
+            }
+
+            address += part * RECORD_SIZE;
+            records -= part;
+        }
+    }
+
+    return 1;
+}
+
+// Load a file at address, without loading more than size bytes.
+// Returns the number of bytes loaded, 0 if the file is not found,
+// DISK_LOAD_ERROR if a sector cannot be read.
+unsigned int load_file(
+    const char *filename,
+    unsigned char *address,
+    unsigned int size
+) {
+    switch(find_file(filename, &loaded)) {
+        case 0: return 0;
+        case DISK_READ_ERROR: return DISK_LOAD_ERROR;
+    }
+
+    return load_blocks(&loaded, address, size);
+}
@@ -0,0 +1,64 @@
+#ifndef DISKLOAD_H
+#define DISKLOAD_H
+
+#include "dpb.h"
+
+#define SECTOR_MAX_SIZE 512
+#define MAX_FILE_BLOCKS 128
+
+// Returned by find_file() when the directory cannot be read
+#define DISK_READ_ERROR 0xff
+
+// Returned by load_blocks() and load_file() when a sector cannot be read,
+// never a size as sizes are whole records
+#define DISK_LOAD_ERROR 0xffff
+
+// Allocation blocks of a file, in file order
+struct disk_file {
+    unsigned int records;                   // Number of 128 bytes records
+    unsigned char block_count;              // Number of blocks used
+    unsigned int blocks[MAX_FILE_BLOCKS];   // Block numbers
+};
+
+// Disc access counters, for benchmarks
+struct disk_stats {
+    unsigned int reads;         // Read operations (runs of sectors)
+    unsigned int sectors;       // Physical sectors read
+    unsigned int seeks;         // Track changes
+};
+
+#ifdef __Z88DK
+extern unsigned char disk_select(unsigned char drive);
+#else
+extern const struct dpb pcw_cf2_dpb;
+extern unsigned char disk_image(const char *path, const struct dpb *dpb);
+#endif
+
+extern struct dpb *disk_dpb();
+extern unsigned char disk_user();
+extern struct disk_stats *disk_stats();
+extern unsigned char read_sectors(
+    unsigned int track,
+    unsigned int sector,
+    unsigned int count,
+    unsigned char *address
+);
+extern unsigned char find_file(const char *filename, struct disk_file *file);
+extern unsigned int load_blocks(
+    struct disk_file *file,
+    unsigned char *address,
+    unsigned int size
+);
+extern unsigned char read_file_records(
+    struct disk_file *file,
+    unsigned int record,
+    unsigned int count,
+    unsigned char *address
+);
+extern unsigned int load_file(
+    const char *filename,
+    unsigned char *address,
+    unsigned int size
+);
+
+#endif
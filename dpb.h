@@ -0,0 +1,43 @@
+#ifndef DPB_H
+#define DPB_H
+
+// CP/M 3 Disc Parameter Block, as returned by BDOS function 31
+struct dpb {
+    // Number of 128-byte records per track
+    unsigned int records_per_track;
+
+    // Block shift. 3 => 1k, 4 => 2k, 5 => 4k....
+    unsigned char block_shift;
+
+    // Block mask. 7 => 1k, 0Fh => 2k, 1Fh => 4k...
+    unsigned char block_mask;
+
+    // Extent mask, number of 16k logical extents per directory entry - 1
+    unsigned char extent_mask;
+
+    // no. of blocks on the disc - 1
+    unsigned int nb_disk_blocks;
+
+    // no. of directory entries - 1
+    unsigned int nb_directory_entries;
+
+    // Directory allocation bitmap
+    unsigned int dir_allocation_bitmap;
+
+    // Checksum vector size, 0 or 8000h for a fixed disc.
+    // No. directory entries/4, rounded up.
+    unsigned int checksum_vector_size;
+
+    // Offset, number of reserved tracks
+    unsigned int reserved_tracks;
+
+    // Physical sector shift, 0 => 128-byte sectors
+    // 1 => 256-byte sectors  2 => 512-byte sectors...
+    unsigned char physical_sector_shift;
+
+    // Physical sector mask,  0 => 128-byte sectors
+    // 1 => 256-byte sectors, 3 => 512-byte sectors...
+    unsigned char physical_sector_mask;
+};
+
+#endif
@@ -1,47 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "dpb.h"
+#include "cpmfile.h"
+#include "diskload.h"
 
 #pragma output noprotectmsdos
 #pragma output noredir
 #pragma output nogfxglobals
 
-struct {
-    // Number of 128-byte records per track
-    unsigned int records_per_track;
-
-    // Block shift. 3 => 1k, 4 => 2k, 5 => 4k....
-    unsigned char block_shift;
-
-    // Block mask. 7 => 1k, 0Fh => 2k, 1Fh => 4k...
-    unsigned char block_mask;
-
-	// Extent mask, see later
-    unsigned char extent_mask;
-
-    // no. of blocks on the disc - 1
-    unsigned int nb_disk_blocks;
-
-    // no. of directory entries - 1
-    unsigned int nb_directory_entries;
-
-    // Directory allocation bitmap
-    unsigned int dir_allocation_bitmap;
-
-    // Checksum vector size, 0 or 8000h for a fixed disc.
-    // No. directory entries/4, rounded up.
-    unsigned int checksum_vector_size;
-
-    // Offset, number of reserved tracks
-    unsigned int reserved_tracks;
-
-    // Physical sector shift, 0 => 128-byte sectors
-    // 1 => 256-byte sectors  2 => 512-byte sectors...
-    unsigned char physical_sector_shift;
-
-    // Physical sector mask,  0 => 128-byte sectors
-    // 1 => 256-byte sectors, 3 => 512-byte sectors...
-    unsigned char physical_sector_mask;
-} *dpb;
+struct dpb *dpb;
 
 char *block_shift[] = {
     "128", "256", "512", "1024", "2048", "4096", "8192", "16384",
@@ -62,9 +31,8 @@ char *block_mask(unsigned char value) {
     }
 }
 
- main() {
-    dpb = (void *)bdos(31, 0);
-
+// Print the Disc Parameter Block.
+void print_dpb() {
     printf(
         "Records per track:                 %d\n",
         dpb->records_per_track
@@ -120,16 +88,293 @@ char *block_mask(unsigned char value) {
     );
 
     printf(
-        "Physical sector shift:             %d-byte sectors (%d)\n",
+        "Physical sector shift:             %s-byte sectors (%d)\n",
         block_shift[dpb->physical_sector_shift],
         dpb->physical_sector_shift
     );
 
     printf(
-        "Physical sector mask:              %d-byte sectors (%d)\n",
-        block_shift[dpb->physical_sector_mask],
+        "Physical sector mask:              %s-byte sectors (%d)\n",
+        block_mask(dpb->physical_sector_mask),
         dpb->physical_sector_mask
     );
+}
+
+// Buffer for the benchmark reads
+#define BENCH_RECORDS 64
+static unsigned char buffer[BENCH_RECORDS * RECORD_SIZE];
+
+// Blocks of the file being measured
+static struct disk_file file;
+
+// Multi-sector counts tried by the sequential read benchmark
+static unsigned char multi_counts[] = { 1, 2, 4, 8, 16, 32, 64, 0 };
+
+// Number of random records read by the random read benchmark
+#define RANDOM_READS 64
+
+// Number of directory searches done by the directory benchmark
+#define DIRECTORY_SEARCHES 10
+
+// Start of the current measure
+static unsigned long start;
+
+#ifdef __Z88DK
+#include <cpm.h>
+
+#define BDOS_SEARCH_FIRST 17
+#define BDOS_SEARCH_NEXT 18
+#define BDOS_CURRENT_DISK 25
+#define BDOS_READ_RANDOM 33
+#define BDOS_MULTI_SECTOR_COUNT 44
+#define BDOS_GET_DATE_TIME 105
+
+// CP/M 3 date: days since 1978, hour, minute (BCD)
+static unsigned char date_time[4];
+
+// Converts a BCD byte.
+unsigned int from_bcd(unsigned char value) {
+    return (value >> 4) * 10 + (value & 15);
+}
+
+// Returns the current time in seconds.
+unsigned long now() {
+    unsigned char seconds;
+
+    seconds = bdos(BDOS_GET_DATE_TIME, date_time);
+    return (date_time[0] + (date_time[1] << 8)) * 86400L
+         + from_bcd(date_time[2]) * 3600L
+         + from_bcd(date_time[3]) * 60
+         + from_bcd(seconds);
+}
+#else
+// Results must not depend on the host speed: no time is measured, only the
+// disc accesses.
+unsigned long now() {
+    return 0;
+}
+#endif
+
+// Start a measure.
+void measure_start() {
+    memset(disk_stats(), 0, sizeof(struct disk_stats));
+    start = now();
+}
+
+// Print the result of a measure. calls is the number of BDOS calls, or of
+// loader calls on the host.
+void measure_end(const char *name, unsigned int calls) {
+    struct disk_stats *stats;
+
+    stats = disk_stats();
+#ifdef __Z88DK
+    printf("%-28s %5u calls %5u s\n", name, calls, (unsigned int)(now() - start));
+#else
+    printf(
+        "%-28s %5u calls %5u reads %5u sectors %5u seeks\n",
+        name, calls, stats->reads, stats->sectors, stats->seeks
+    );
+#endif
+}
+
+#ifdef __Z88DK
+// Name of the file being benchmarked, opened again by each benchmark
+static const char *benchmark_name;
+#endif
+
+// Read the benchmarked file sequentially, count records at a time.
+unsigned int sequential_read(unsigned char count) {
+    unsigned int calls;
+#ifdef __Z88DK
+    struct cpm_fcb fcb;
+
+    if(!fcb_open(&fcb, benchmark_name)) return 0;
+
+    bdos(BDOS_MULTI_SECTOR_COUNT, count);
+    bdos(BDOS_SET_DMA, buffer);
+    for(calls = 1; (bdos(BDOS_READ_SEQUENTIAL, &fcb) & 0xff) == 0; calls++);
+    bdos(BDOS_MULTI_SECTOR_COUNT, 1);
+
+    fcb_close(&fcb);
+#else
+    unsigned int record;
+
+    calls = 0;
+    for(record = 0; record < file.records; record += count) {
+        read_file_records(&file, record, count, buffer);
+        calls++;
+    }
+#endif
+
+    return calls;
+}
+
+// Read records of the benchmarked file at random. The records are always the
+// same ones so results can be compared.
+unsigned int random_read() {
+    unsigned int seed;
+    unsigned int record;
+    unsigned char i;
+#ifdef __Z88DK
+    struct cpm_fcb fcb;
+
+    if(!fcb_open(&fcb, benchmark_name)) return 0;
+    bdos(BDOS_SET_DMA, buffer);
+#endif
+
+    seed = 1;
+    for(i = 0; i != RANDOM_READS; i++) {
+        seed = seed * 25173 + 13849;
+        record = seed % file.records;
+#ifdef __Z88DK
+        fcb.random[0] = record & 0xff;
+        fcb.random[1] = record >> 8;
+        fcb.random[2] = 0;
+        bdos(BDOS_READ_RANDOM, &fcb);
+#else
+        read_file_records(&file, record, 1, buffer);
+#endif
+    }
+
+#ifdef __Z88DK
+    fcb_close(&fcb);
+#endif
+
+    return RANDOM_READS;
+}
+
+// Search every directory entry.
+unsigned int directory_search() {
+    unsigned char i;
+#ifdef __Z88DK
+    struct cpm_fcb fcb;
+
+    fcb_set_name(&fcb, "????????.???");
+    bdos(BDOS_SET_DMA, buffer);
+    for(i = 0; i != DIRECTORY_SEARCHES; i++) {
+        if((bdos(BDOS_SEARCH_FIRST, &fcb) & 0xff) == 0xff) continue;
+        while((bdos(BDOS_SEARCH_NEXT, &fcb) & 0xff) != 0xff);
+    }
+#else
+    // A file which does not exist needs the whole directory to be read
+    for(i = 0; i != DIRECTORY_SEARCHES; i++) find_file("?", &file);
+#endif
+
+    return DIRECTORY_SEARCHES;
+}
+
+// Print the read benchmarks of a file.
+void benchmark(const char *filename) {
+    unsigned char i;
+    char name[32];
+
+    i = find_file(filename, &file);
+    if(i == DISK_READ_ERROR) {
+        printf("%s: directory read error\n", filename);
+        return;
+    }
+
+    if(i == 0 || file.records == 0) {
+        printf("%s not found\n", filename);
+        return;
+    }
+
+    printf("\n%s: %u records\n", filename, file.records);
+#ifdef __Z88DK
+    benchmark_name = filename;
+#endif
+
+    for(i = 0; multi_counts[i] != 0; i++) {
+        sprintf(name, "Sequential, %u records", multi_counts[i]);
+        measure_start();
+        measure_end(name, sequential_read(multi_counts[i]));
+    }
+
+    measure_start();
+    measure_end("Random, 1 record", random_read());
+
+    measure_start();
+    measure_end("Directory search", directory_search());
+}
+
+// Print the fragmentation of each file of the current user, the files
+// find_file() sees: a fragment is a run of blocks which follow each other in
+// track and sector order.
+void print_fragmentation() {
+    unsigned int entry;
+    unsigned int first;
+    unsigned int per_track;
+    unsigned char fragments;
+    unsigned char i;
+    unsigned char j;
+    unsigned char *directory;
+    char filename[13];
+
+    printf("\nFiles of user %u\n", disk_user());
+    printf("File          Records Blocks Fragments\n");
+
+    per_track = dpb->records_per_track >> dpb->physical_sector_shift;
+    first = dpb->reserved_tracks * per_track;
+
+    for(entry = 0; entry <= dpb->nb_directory_entries; entry++) {
+        // Directory sectors are read one at a time into the benchmark buffer
+        directory = buffer
+                  + ((entry * 32) & ((RECORD_SIZE << dpb->physical_sector_shift) - 1));
+        if(directory == buffer) {
+            if(!read_sectors(first / per_track, first % per_track, 1, buffer)) {
+                printf("Directory read error\n");
+                return;
+            }
+            first++;
+        }
+
+        // Only the first entry of a file is used, holding the logical
+        // extents 0 to extent_mask
+        if(directory[0] != disk_user()
+           || (directory[12] & ~dpb->extent_mask) != 0
+           || directory[14] != 0) {
+            continue;
+        }
+
+        j = 0;
+        for(i = 1; i != 12; i++) {
+            if(i == 9) filename[j++] = '.';
+            if((directory[i] & 0x7f) != ' ') filename[j++] = directory[i] & 0x7f;
+        }
+        filename[j] = '\0';
+
+        if(find_file(filename, &file) != 1) continue;
+        fragments = file.block_count != 0;
+        for(i = 1; i < file.block_count; i++) {
+            if(file.blocks[i] != file.blocks[i - 1] + 1) fragments++;
+        }
+
+        printf(
+            "%-13s %7u %6u %9u\n",
+            filename, file.records, file.block_count, fragments
+        );
+    }
+}
+
+// Usage: dpbinfo [FILE]
+// On the host: dpbinfo IMAGE [FILE], IMAGE being a raw CF2 disc image.
+int main(int argc, char *argv[]) {
+#ifdef __Z88DK
+    dpb = (void *)bdos(31, 0);
+    disk_select(bdos(BDOS_CURRENT_DISK, 0) & 0xff);
+#else
+    if(argc < 2 || !disk_image(argv[1], &pcw_cf2_dpb)) {
+        printf("Usage: dpbinfo IMAGE [FILE]\n");
+        return 1;
+    }
+    dpb = disk_dpb();
+    argc--;
+    argv++;
+#endif
+
+    print_dpb();
+    print_fragmentation();
+    if(argc > 1) benchmark(argv[1]);
 
     return 0;
 }
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cpm.h>
+#include "videoram.h"
+#include "cpmfile.h"
+#include "hardcopy.h"
+
+// The screen stores a cell as 8 bytes, one per pixel line, while the printer
+// takes a byte per column of 8 dots, the top dot in bit 7. Each row of cells
+// is transposed into line_buffer and sent as graphics blocks. Blank cells
+// at the end of a row are neither transposed nor sent, long runs of blank
+// columns inside a row are skipped by moving the print head, and blank rows
+// are only a line feed, so the time spent is the printer's.
+
+#define BDOS_LIST_OUTPUT 5
+
+// Blank columns worth ending a graphics block for: moving the print head and
+// starting the next block costs 8 bytes.
+#define SKIP_COLUMNS 16
+
+// Columns of dots of the row being printed
+static unsigned char line_buffer[SCREEN_WIDTH];
+
+// Printer data goes to a file instead of the list device when set
+static unsigned char to_file;
+
+// File standing in for the printer, and its record being filled
+static struct cpm_fcb fcb;
+static unsigned char record[RECORD_SIZE];
+static unsigned char record_fill;
+
+// Send a byte to the printer, or add it to the file record.
+// Returns 0 if the file cannot be written, 1 otherwise.
+static unsigned char put_byte(unsigned char value) {
+    if(!to_file) {
+        bdos(BDOS_LIST_OUTPUT, value);
+        return 1;
+    }
+
+    record[record_fill++] = value;
+    if(record_fill != RECORD_SIZE) return 1;
+
+    record_fill = 0;
+    return fcb_write(&fcb, record);
+}
+
+// Send an escape sequence with one parameter.
+static unsigned char put_escape(unsigned char command, unsigned char value) {
+    return put_byte(ESC) && put_byte(command) && put_byte(value);
+}
+
+// Transpose count cells to columns of dots: bit 7 - x of line y of a cell
+// becomes bit 7 - y of column x.
+static void transpose_cells(
+    const unsigned char *cells,
+    unsigned char *columns,
+    unsigned char count
+) {
+/*
+    unsigned char x;
+    unsigned char y;
+    unsigned char bits;
+
+    for(; count != 0; count--, cells += 8, columns += 8) {
+        for(y = 0; y != 8; y++) {
+            bits = cells[y];
+            for(x = 0; x != 8; x++) {
+                columns[x] = (columns[x] << 1) | (bits >> 7);
+                bits <<= 1;
+            }
+        }
+    }
+*/
+#asm
+    ; cells +8, columns +6, count +4
+    push ix
+    ld ix, 0
+    add ix, sp
+
+    ld c, (ix+4)
+    ld l, (ix+8)
+    ld h, (ix+9)
+    ld e, (ix+6)
+    ld d, (ix+7)
+    push de
+    pop ix
+    ld de, 8
+
+    ld a, c
+    or a
+    jr z, end_tc
+
+.cell_tc
+    ; Each line of the cell shifts one bit into every column, the 8 shifts
+    ; leave the first line in bit 7
+    ld b, 8
+.line_tc
+    ld a, (hl)
+    inc hl
+    rla
+    rl (ix+0)
+    rla
+    rl (ix+1)
+    rla
+    rl (ix+2)
+    rla
+    rl (ix+3)
+    rla
+    rl (ix+4)
+    rla
+    rl (ix+5)
+    rla
+    rl (ix+6)
+    rla
+    rl (ix+7)
+    djnz line_tc
+
+    ; columns += 8
+    add ix, de
+    dec c
+    jr nz, cell_tc
+
+.end_tc
+    pop ix
+    ret
+#endasm
+}
+
+// Send the columns of line_buffer from start to end as a graphics block,
+// moving the print head to start first when it is not the left margin.
+// Returns 0 if the file cannot be written, 1 otherwise.
+static unsigned char print_block(unsigned int start, unsigned int end) {
+    unsigned char *column;
+    unsigned char ok;
+
+    ok = 1;
+    if(start != 0) {
+        ok = put_escape(PRINTER_POSITION, (start >> 1) & 0xff)
+          && put_byte(start >> 9);
+    }
+
+    ok = ok && put_escape(PRINTER_DOUBLE_DENSITY, (end - start) & 0xff)
+      && put_byte((end - start) >> 8);
+    for(column = line_buffer + start; ok && start != end; start++) {
+        ok = put_byte(*column++);
+    }
+
+    return ok;
+}
+
+// Print a row of cells of the screen. The columns are sent in blocks split
+// at runs of SKIP_COLUMNS blank columns or more. Positions being in 1/60
+// inch, that is 2 columns, a block starts at an even column.
+// Returns 0 if the file cannot be written, 1 otherwise.
+static unsigned char print_row(const unsigned char *cells) {
+    const unsigned char *scan;
+    unsigned char count;
+    unsigned int width;
+    unsigned int start;
+    unsigned int end;
+    unsigned char blank;
+    unsigned char ok;
+
+    // Cells up to the last one with a pixel set
+    scan = cells + SCREEN_WIDTH;
+    while(scan != cells && scan[-1] == 0) scan--;
+    count = (scan - cells + 7) >> 3;
+
+    ok = 1;
+    if(count != 0) {
+        transpose_cells(cells, line_buffer, count);
+
+        // Columns up to the last one with a dot set
+        width = count * 8;
+        while(line_buffer[width - 1] == 0) width--;
+
+        // Leading blank columns are only skipped when they are many
+        for(start = 0; line_buffer[start] == 0; start++);
+        if(start < SKIP_COLUMNS) start = 0;
+
+        while(ok && start != width) {
+            start &= ~1;
+
+            // The block ends at the first column of a long blank run
+            blank = 0;
+            for(end = start; end != width; end++) {
+                if(line_buffer[end] != 0) blank = 0;
+                else if(++blank == SKIP_COLUMNS) break;
+            }
+            if(end != width) end -= SKIP_COLUMNS - 1;
+
+            ok = print_block(start, end);
+
+            // The last column is not blank, so the next block is found
+            for(start = end; start != width && line_buffer[start] == 0; start++);
+        }
+    }
+
+    return ok && put_byte('\r') && put_byte('\n');
+}
+
+// Print the screen on the list device or, if filename is not NULL, write the
+// printer data to that file, to be printed later.
+// Returns 0 if the file cannot be written, 1 otherwise.
+unsigned char hardcopy(const char *filename) {
+    unsigned char *cells;
+    unsigned char row;
+    unsigned char ok;
+
+    to_file = filename != NULL;
+    record_fill = 0;
+    if(to_file && !fcb_create(&fcb, filename)) return 0;
+
+    ok = put_byte(ESC) && put_byte(PRINTER_RESET)
+      && put_escape(PRINTER_LINE_SPACING, 8)
+      && put_escape(PRINTER_UNIDIRECTIONAL, 1);
+
+    cells = get_screen();
+    for(row = 0; ok && row != SCREEN_HEIGHT / 8; row++) {
+        ok = print_row(cells);
+        cells += SCREEN_WIDTH;
+    }
+
+    ok = ok && put_byte(ESC) && put_byte(PRINTER_RESET);
+
+    if(to_file) {
+        // Complete the last record with CP/M end of file marks
+        while(ok && record_fill != 0) ok = put_byte(0x1a);
+        fcb_close(&fcb);
+    }
+
+    return ok;
+}
@@ -0,0 +1,17 @@
+#ifndef HARDCOPY_H
+#define HARDCOPY_H
+
+// Epson compatible 8 pins graphics: each text row of the screen is printed
+// as one line of 720 columns of 8 dots in 120 dpi double density, the line
+// feed set to 8 dots. Blank parts of a line are skipped by moving the print
+// head to an absolute position, in 1/60 inch.
+#define ESC 27
+#define PRINTER_RESET '@'
+#define PRINTER_LINE_SPACING 'A'
+#define PRINTER_UNIDIRECTIONAL 'U'
+#define PRINTER_DOUBLE_DENSITY 'L'
+#define PRINTER_POSITION '$'
+
+extern unsigned char hardcopy(const char *filename);
+
+#endif
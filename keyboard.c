@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "keyboard.h"
+
+// The keyboard is read from its matrix instead of the BDOS, so held keys are
+// seen together and a key press is known at the next scan. key_scan() reads
+// the matrix, filters bounces and queues a press or release event for each
+// key whose state changed. A change is accepted when it is read by two scans
+// in a row.
+
+#ifdef __Z88DK
+#include <cpm.h>
+
+#define BDOS_DIRECT_IO 6
+#define DIRECT_IO_INPUT 0xFF
+
+#define matrix ((volatile unsigned char *)KEY_MATRIX)
+#else
+// Stand-in for the keyboard matrix on the host
+unsigned char key_host_matrix[KEY_ROWS];
+
+#define matrix key_host_matrix
+#endif
+
+// Keyboard state
+static struct {
+    unsigned char state[KEY_ROWS];      // Debounced keys, one bit per key
+    unsigned char pending[KEY_ROWS];    // Keys read different from state once
+    unsigned char queue[KEY_QUEUE_SIZE];// Events not read yet
+    unsigned char head;                 // Next event to read
+    unsigned char tail;                 // Next free event slot
+} keyboard;
+
+// Take the keys currently down as the initial state, without events.
+void key_init() {
+    memset(&keyboard, 0, sizeof(keyboard));
+    memcpy(keyboard.state, (void *)matrix, KEY_ROWS);
+}
+
+// Read the matrix and queue an event for each key which changed. Events are
+// dropped when the queue is full.
+void key_scan() {
+    unsigned char row;
+    unsigned char bit;
+    unsigned char changed;
+    unsigned char accepted;
+    unsigned char code;
+
+    for(row = 0; row < KEY_ROWS; row++) {
+        changed = matrix[row] ^ keyboard.state[row];
+        accepted = changed & keyboard.pending[row];
+        keyboard.pending[row] = changed & ~accepted;
+
+        if(accepted == 0) continue;
+
+        keyboard.state[row] ^= accepted;
+
+        code = row << 3;
+        for(bit = 1; bit != 0; bit <<= 1, code++) {
+            if((accepted & bit) == 0) continue;
+            if(((keyboard.tail + 1) & (KEY_QUEUE_SIZE - 1)) == keyboard.head) {
+                continue;
+            }
+
+            keyboard.queue[keyboard.tail] = keyboard.state[row] & bit
+                                          ? code | KEY_PRESSED
+                                          : code;
+            keyboard.tail = (keyboard.tail + 1) & (KEY_QUEUE_SIZE - 1);
+        }
+    }
+}
+
+// Returns the debounced state of the keys, KEY_ROWS bytes.
+unsigned char *key_state() {
+    return keyboard.state;
+}
+
+// Returns 1 if the key is down, 0 otherwise.
+unsigned char key_down(unsigned char key) {
+    return (keyboard.state[key >> 3] >> (key & 7)) & 1;
+}
+
+// Returns the next event, or KEY_NONE if there is none.
+unsigned char key_event() {
+    unsigned char event;
+
+    if(keyboard.head == keyboard.tail) return KEY_NONE;
+
+    event = keyboard.queue[keyboard.head];
+    keyboard.head = (keyboard.head + 1) & (KEY_QUEUE_SIZE - 1);
+    return event;
+}
+
+// Wait for a character, like getchar() but without echo nor line editing.
+// The firmware still translates keys to characters, they are read with the
+// direct console input of the BDOS. The matrix is scanned while waiting so
+// the events stay in step with the characters.
+int key_getchar() {
+#ifdef __Z88DK
+    unsigned char c;
+
+    for(;;) {
+        key_scan();
+        c = bdos(BDOS_DIRECT_IO, DIRECT_IO_INPUT);
+        if(c != 0) return c;
+    }
+#else
+    key_scan();
+    return getchar();
+#endif
+}
@@ -0,0 +1,33 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+// The keyboard matrix is mapped at 0x3FF0 of memory block 3, which CP/M Plus
+// keeps at 0xC000, so the matrix is read at 0xFFF0. Each byte is a line of
+// the matrix, each bit a key, set while the key is down.
+#define KEY_MATRIX 0xFFF0
+#define KEY_ROWS 11
+
+// A key code is the matrix line times 8 plus the bit number
+#define KEY_CODE(row, bit) (((row) << 3) + (bit))
+#define KEY_COUNT (KEY_ROWS * 8)
+
+// Events are a key code, with KEY_PRESSED set when the key went down
+#define KEY_PRESSED 0x80
+#define KEY_NONE 0xFF
+
+// Number of events kept until read, must be a power of 2
+#define KEY_QUEUE_SIZE 16
+
+#ifndef __Z88DK
+// Matrix lines set by the program in place of the keyboard
+extern unsigned char key_host_matrix[KEY_ROWS];
+#endif
+
+extern void key_init();
+extern void key_scan();
+extern unsigned char *key_state();
+extern unsigned char key_down(unsigned char key);
+extern unsigned char key_event();
+extern int key_getchar();
+
+#endif
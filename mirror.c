@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cpm.h>
+#include "videoram.h"
+#include "arena.h"
+#include "cpmfile.h"
+#include "mirror.h"
+
+// The screen is mirrored by sending the cells changed since the last update.
+// Instead of a copy of the screen, a 16 bits Fletcher checksum of each cell
+// is kept (5760 bytes instead of 23040): the low byte is the sum of the 8
+// bytes of the cell, the high byte the sum of the partial sums, so any change
+// of one byte, and most changes of several, alter the checksum.
+
+#define BDOS_AUX_OUTPUT 4
+
+// Mirroring state
+static struct {
+    unsigned char *sums;                    // Checksums of the cells sent
+    unsigned char full;                     // Send every cell next update
+    unsigned char to_file;                  // Send to fcb instead of AUX
+} mirror;
+
+// Set for each cell of the row being checked which changed
+static unsigned char changed[MIRROR_COLUMNS];
+
+// File standing in for the serial link, and its record being filled
+static struct cpm_fcb fcb;
+static unsigned char record[RECORD_SIZE];
+static unsigned char record_fill;
+
+// Take the checksums from the arena. The first update sends every cell.
+// Returns 0 if there is not enough memory, 1 otherwise.
+unsigned char init_mirror() {
+    mirror.sums = arena_alloc(MIRROR_COLUMNS * MIRROR_ROWS * 2);
+    mirror.full = 1;
+    mirror.to_file = 0;
+
+    return mirror.sums != NULL;
+}
+
+// Send every cell at the next update, when the receiver starts again.
+void mirror_invalidate() {
+    mirror.full = 1;
+}
+
+// Send the updates to a file instead of the auxiliary device, until
+// mirror_close(). Returns 0 if the file cannot be created, 1 otherwise.
+unsigned char mirror_file(const char *filename) {
+    if(!fcb_create(&fcb, filename)) return 0;
+
+    mirror.to_file = 1;
+    record_fill = 0;
+    return 1;
+}
+
+// Close the file given to mirror_file() and send to the auxiliary device
+// again. The last record is completed with bytes ignored by the receiver.
+void mirror_close() {
+    if(!mirror.to_file) return;
+
+    if(record_fill != 0) {
+        memset(record + record_fill, 0x1a, RECORD_SIZE - record_fill);
+        fcb_write(&fcb, record);
+    }
+
+    fcb_close(&fcb);
+    mirror.to_file = 0;
+}
+
+// Send a byte to the auxiliary device, or add it to the file record.
+// Returns 0 if the file cannot be written, 1 otherwise.
+static unsigned char put_byte(unsigned char value) {
+    if(!mirror.to_file) {
+        bdos(BDOS_AUX_OUTPUT, value);
+        return 1;
+    }
+
+    record[record_fill++] = value;
+    if(record_fill != RECORD_SIZE) return 1;
+
+    record_fill = 0;
+    return fcb_write(&fcb, record);
+}
+
+// Send length bytes compressed with PackBits RLE.
+// Returns 0 if the file cannot be written, 1 otherwise.
+static unsigned char put_rle(const unsigned char *current, unsigned int length) {
+    const unsigned char *end;
+    const unsigned char *scan;
+    unsigned char count;
+    unsigned char ok;
+
+    ok = 1;
+    end = current + length;
+    while(ok && current != end) {
+        // Repeated bytes
+        for(count = 1; count != 128; count++) {
+            if(current + count == end || current[count] != *current) break;
+        }
+
+        if(count >= 3) {
+            ok = put_byte(257 - count) && put_byte(*current);
+            current += count;
+            continue;
+        }
+
+        // Literal bytes, up to the next run of 3 repeated bytes
+        scan = current;
+        for(count = 0; count != 128 && scan != end; count++, scan++) {
+            if(scan + 2 < end && scan[0] == scan[1] && scan[1] == scan[2]) {
+                break;
+            }
+        }
+
+        ok = put_byte(count - 1);
+        for(; ok && current != scan; current++) ok = put_byte(*current);
+    }
+
+    return ok;
+}
+
+// Compute the checksums of a row of cells, set changed for the cells whose
+// checksum differs from sums and store the new checksums in sums.
+static void row_changes(const unsigned char *cells, unsigned char *sums) {
+/*
+    unsigned char col;
+    unsigned char i;
+    unsigned char low;
+    unsigned char high;
+
+    for(col = 0; col != MIRROR_COLUMNS; col++, sums += 2) {
+        low = 0;
+        high = 0;
+        for(i = 0; i != 8; i++) {
+            low += *cells++;
+            high += low;
+        }
+
+        changed[col] = sums[0] != low || sums[1] != high;
+        sums[0] = low;
+        sums[1] = high;
+    }
+*/
+#asm
+    ; cells +4, sums +2
+    pop af
+    pop de
+    pop hl
+    push hl
+    push de
+    push af
+
+    push iy
+    ld iy, _changed
+    ld a, 90
+.cell_rc
+    push af
+
+    ; c = low, b = high
+    ld bc, 0
+    ld a, c
+    add a, (hl)
+    ld c, a
+    add a, b
+    ld b, a
+    inc hl
+    ld a, c
+    add a, (hl)
+    ld c, a
+    add a, b
+    ld b, a
+    inc hl
+    ld a, c
+    add a, (hl)
+    ld c, a
+    add a, b
+    ld b, a
+    inc hl
+    ld a, c
+    add a, (hl)
+    ld c, a
+    add a, b
+    ld b, a
+    inc hl
+    ld a, c
+    add a, (hl)
+    ld c, a
+    add a, b
+    ld b, a
+    inc hl
+    ld a, c
+    add a, (hl)
+    ld c, a
+    add a, b
+    ld b, a
+    inc hl
+    ld a, c
+    add a, (hl)
+    ld c, a
+    add a, b
+    ld b, a
+    inc hl
+    ld a, c
+    add a, (hl)
+    ld c, a
+    add a, b
+    ld b, a
+    inc hl
+
+    ; changed[col] = sums[0] != low || sums[1] != high
+    ld (iy+0), 1
+    ld a, (de)
+    cp c
+    jr nz, low_rc
+    inc de
+    ld a, (de)
+    cp b
+    jr nz, high_rc
+    ld (iy+0), 0
+    jr next_rc
+
+.low_rc
+    ld a, c
+    ld (de), a
+    inc de
+.high_rc
+    ld a, b
+    ld (de), a
+
+.next_rc
+    inc de
+    inc iy
+    pop af
+    dec a
+    jr nz, cell_rc
+
+    pop iy
+    ret
+#endasm
+}
+
+// Send the cells changed since the last update, as runs of consecutive
+// changed cells. Returns 0 if the file cannot be written, 1 otherwise; the
+// next update then sends every cell.
+unsigned char mirror_sync() {
+    unsigned char *cells;
+    unsigned char *sums;
+    unsigned char row;
+    unsigned char col;
+    unsigned char count;
+    unsigned char ok;
+
+    ok = put_byte(MIRROR_START);
+    cells = get_screen();
+    sums = mirror.sums;
+    for(row = 0; ok && row != MIRROR_ROWS; row++) {
+        row_changes(cells, sums);
+        if(mirror.full) memset(changed, 1, MIRROR_COLUMNS);
+
+        for(col = 0; ok && col != MIRROR_COLUMNS; col += count) {
+            if(!changed[col]) {
+                count = 1;
+                continue;
+            }
+
+            for(count = 1; col + count != MIRROR_COLUMNS; count++) {
+                if(!changed[col + count]) break;
+            }
+
+            ok = put_byte(row) && put_byte(col) && put_byte(count)
+              && put_rle(cells + col * 8, count * 8);
+        }
+
+        cells += SCREEN_WIDTH;
+        sums += MIRROR_COLUMNS * 2;
+    }
+
+    ok = ok && put_byte(MIRROR_END);
+    mirror.full = !ok;
+
+    return ok;
+}
@@ -0,0 +1,24 @@
+#ifndef MIRROR_H
+#define MIRROR_H
+
+// Mirroring protocol. An update starts with MIRROR_START and ends with
+// MIRROR_END. In between, each run of consecutive changed cells of a row is
+// sent as its row (0 to 31), its first column (0 to 89), its number of
+// cells (1 to 90), then the 8 bytes of each cell in screen order,
+// compressed with PackBits RLE like screen image files: a control byte n
+// from 0 to 127 is followed by n + 1 literal bytes, a control byte n from
+// 129 to 255 is followed by one byte to repeat 257 - n times. Bytes between
+// MIRROR_END and the next MIRROR_START are ignored.
+#define MIRROR_START 0xFE
+#define MIRROR_END 0xFF
+
+#define MIRROR_COLUMNS 90
+#define MIRROR_ROWS 32
+
+extern unsigned char init_mirror();
+extern void mirror_invalidate();
+extern unsigned char mirror_file(const char *filename);
+extern void mirror_close();
+extern unsigned char mirror_sync();
+
+#endif
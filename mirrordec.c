@@ -0,0 +1,129 @@
+// mirrordec: receives the screen updates sent by mirror.c and writes the
+// mirrored screen as a PBM image after each update. This is a host (Linux)
+// program.
+//
+// Usage: mirrordec input output.pbm
+//
+// The input is the serial device the PCW auxiliary output is connected to,
+// a pipe, or a file written by mirror_file().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mirror.h"
+
+#define CELL_SIZE 8
+#define ROW_SIZE (MIRROR_COLUMNS * CELL_SIZE)
+#define SCREEN_BYTES (MIRROR_ROWS * ROW_SIZE)
+
+// Mirrored screen memory, in the cell order of the PCW
+static unsigned char screen[SCREEN_BYTES];
+
+static void fail(const char *message, const char *detail) {
+    fprintf(stderr, "mirrordec: %s%s%s\n", message, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+static int next_byte(FILE *input) {
+    int value;
+
+    value = fgetc(input);
+    if(value == EOF) fail("truncated update", NULL);
+    return value;
+}
+
+// Decompress length bytes of PackBits RLE data to address.
+static void read_rle(FILE *input, unsigned char *address, int length) {
+    int control;
+    int count;
+
+    while(length > 0) {
+        control = next_byte(input);
+        if(control < 128) {
+            for(count = control + 1; count != 0; count--, length--) {
+                if(length <= 0) fail("run past the cells", NULL);
+                *address++ = next_byte(input);
+            }
+        } else if(control != 128) {
+            count = 257 - control;
+            if(count > length) fail("run past the cells", NULL);
+            memset(address, next_byte(input), count);
+            address += count;
+            length -= count;
+        }
+    }
+}
+
+// Read an update, MIRROR_START having been read. Returns the number of cells
+// updated.
+static int read_update(FILE *input) {
+    int row;
+    int col;
+    int count;
+    int cells;
+
+    cells = 0;
+    for(;;) {
+        row = next_byte(input);
+        if(row == MIRROR_END) return cells;
+
+        col = next_byte(input);
+        count = next_byte(input);
+        if(row >= MIRROR_ROWS || count == 0 || col + count > MIRROR_COLUMNS) {
+            fail("invalid run", NULL);
+        }
+
+        read_rle(input, screen + row * ROW_SIZE + col * CELL_SIZE, count * CELL_SIZE);
+        cells += count;
+    }
+}
+
+// Write the screen as a 720x256 PBM image, through a temporary file so a
+// viewer never reads a partial image.
+static void save_pbm(const char *path) {
+    char temporary[1024];
+    FILE *file;
+    int x;
+    int y;
+
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    file = fopen(temporary, "wb");
+    if(file == NULL) fail("cannot create", temporary);
+
+    fprintf(file, "P4\n%d %d\n", MIRROR_COLUMNS * 8, MIRROR_ROWS * 8);
+    for(y = 0; y != MIRROR_ROWS * 8; y++) {
+        for(x = 0; x != MIRROR_COLUMNS; x++) {
+            fputc(screen[(y >> 3) * ROW_SIZE + x * CELL_SIZE + (y & 7)], file);
+        }
+    }
+
+    fclose(file);
+    if(rename(temporary, path) != 0) fail("cannot replace", path);
+}
+
+int main(int argc, char *argv[]) {
+    FILE *input;
+    int value;
+    int updates;
+    int cells;
+
+    if(argc != 3) {
+        fprintf(stderr, "Usage: mirrordec input output.pbm\n");
+        return 1;
+    }
+
+    input = fopen(argv[1], "rb");
+    if(input == NULL) fail("cannot open", argv[1]);
+
+    updates = 0;
+    while((value = fgetc(input)) != EOF) {
+        if(value != MIRROR_START) continue;
+
+        cells = read_update(input);
+        save_pbm(argv[2]);
+        fprintf(stderr, "update %d: %d cells\n", ++updates, cells);
+    }
+
+    fclose(input);
+    return 0;
+}
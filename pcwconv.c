@@ -0,0 +1,573 @@
+// pcwconv: converts images and fonts into the runtime layouts of videoram.c,
+// and back to images for verification. This is a host (Linux) program.
+//
+// Usage: pcwconv [-d] [-l layout] [-c name] [-w width] [-h height] in out
+//
+// Inputs are PBM, PGM or PPM images (dark pixels are set) and BDF fonts.
+// Layouts:
+//   font     8 bytes per glyph, from a BDF font or an image of 8x8 glyphs
+//   double   16 bytes per glyph, the glyph pre-expanded for double width:
+//            8 bytes for the left half then 8 bytes for the right half
+//   cells    bitmap in screen cell order: rows of 8 lines, each row made of
+//            8 bytes cells, left to right
+//   shifted  8 copies of a cells bitmap, shifted right by 0 to 7 pixels,
+//            each one being one cell wider than the image
+//   screen   720x256 image as a screen image file for load_screen()
+// The output is binary unless -c gives the name of a C array to write.
+// With -d, a binary file in the given layout is decoded back to a PBM image;
+// -w and -h give the image size for the cells and shifted layouts. The 8
+// copies of the shifted layout are all decoded and checked to give the same
+// image.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "screenfile.h"
+
+#define GLYPHS 256
+#define SCREEN_FILE_HEADER 128
+
+// A 1 bit per pixel image, one byte per pixel
+struct bitmap {
+    int width;
+    int height;
+    unsigned char *pixels;
+};
+
+// Output being built
+struct output {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static void fail(const char *message, const char *detail) {
+    fprintf(stderr, "pcwconv: %s%s%s\n", message, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+static void new_bitmap(struct bitmap *bitmap, int width, int height) {
+    bitmap->width = width;
+    bitmap->height = height;
+    bitmap->pixels = calloc((size_t)width * height, 1);
+    if(bitmap->pixels == NULL) fail("out of memory", NULL);
+}
+
+static int get_pixel(const struct bitmap *bitmap, int x, int y) {
+    if(x < 0 || y < 0 || x >= bitmap->width || y >= bitmap->height) return 0;
+    return bitmap->pixels[y * bitmap->width + x];
+}
+
+static void set_pixel(struct bitmap *bitmap, int x, int y, int value) {
+    if(x < 0 || y < 0 || x >= bitmap->width || y >= bitmap->height) return;
+    bitmap->pixels[y * bitmap->width + x] = value != 0;
+}
+
+static void put_byte(struct output *output, unsigned char value) {
+    if(output->size == output->capacity) {
+        output->capacity = output->capacity ? output->capacity * 2 : 4096;
+        output->data = realloc(output->data, output->capacity);
+        if(output->data == NULL) fail("out of memory", NULL);
+    }
+    output->data[output->size++] = value;
+}
+
+// Returns the 8 pixels starting at (x, y), leftmost pixel in bit 7.
+static unsigned char get_byte(const struct bitmap *bitmap, int x, int y) {
+    unsigned char value;
+    int i;
+
+    value = 0;
+    for(i = 0; i != 8; i++) value = (value << 1) | get_pixel(bitmap, x + i, y);
+    return value;
+}
+
+static void set_byte(struct bitmap *bitmap, int x, int y, unsigned char value) {
+    int i;
+
+    for(i = 0; i != 8; i++) set_pixel(bitmap, x + i, y, value & (0x80 >> i));
+}
+
+// Reads the next number of a netpbm header, skipping comments.
+static int read_number(FILE *file) {
+    int c;
+    int value;
+
+    do {
+        c = fgetc(file);
+        if(c == '#') while(c != '\n' && c != EOF) c = fgetc(file);
+    } while(isspace(c));
+
+    if(!isdigit(c)) fail("bad netpbm file", NULL);
+
+    value = 0;
+    while(isdigit(c)) {
+        value = value * 10 + c - '0';
+        c = fgetc(file);
+    }
+
+    return value;
+}
+
+// Loads a PBM, PGM or PPM image, plain or raw. Dark pixels are set.
+static void load_netpbm(FILE *file, struct bitmap *bitmap) {
+    int format;
+    int maxval;
+    int samples;
+    int x;
+    int y;
+    int i;
+    int value;
+    int sum;
+
+    if(fgetc(file) != 'P') fail("not a netpbm file", NULL);
+    format = fgetc(file) - '0';
+    if(format < 1 || format > 6) fail("not a netpbm file", NULL);
+
+    x = read_number(file);
+    y = read_number(file);
+    new_bitmap(bitmap, x, y);
+
+    maxval = (format == 1 || format == 4) ? 1 : read_number(file);
+    value = 0;
+    samples = (format == 3 || format == 6) ? 3 : 1;
+
+    for(y = 0; y != bitmap->height; y++) {
+        for(x = 0; x != bitmap->width; x++) {
+            if(format == 4) {
+                // Raw PBM, 8 pixels per byte, each line starting a new byte
+                if((x & 7) == 0) value = fgetc(file);
+                set_pixel(bitmap, x, y, value & (0x80 >> (x & 7)));
+                continue;
+            }
+
+            sum = 0;
+            for(i = 0; i != samples; i++) {
+                if(format <= 3) {
+                    sum += read_number(file);
+                } else if(maxval < 256) {
+                    sum += fgetc(file);
+                } else {
+                    sum += fgetc(file) << 8;
+                    sum += fgetc(file);
+                }
+            }
+
+            if(format == 1) {
+                set_pixel(bitmap, x, y, sum);
+            } else {
+                set_pixel(bitmap, x, y, sum * 2 < maxval * samples);
+            }
+        }
+    }
+}
+
+static void save_pbm(const char *path, const struct bitmap *bitmap) {
+    FILE *file;
+    int x;
+    int y;
+
+    file = fopen(path, "wb");
+    if(file == NULL) fail("cannot create", path);
+
+    fprintf(file, "P4\n%d %d\n", bitmap->width, bitmap->height);
+    for(y = 0; y != bitmap->height; y++) {
+        for(x = 0; x < bitmap->width; x += 8) fputc(get_byte(bitmap, x, y), file);
+    }
+
+    fclose(file);
+}
+
+// Loads a BDF font into a 128x128 image of 16x16 glyphs of 8x8 pixels. Glyphs
+// are placed on a common baseline given by the font bounding box and clipped
+// to 8x8.
+static void load_bdf(FILE *file, struct bitmap *bitmap) {
+    char line[256];
+    int font_x;
+    int font_y;
+    int font_height;
+    int encoding;
+    int width;
+    int height;
+    int x_offset;
+    int y_offset;
+    int row;
+    int top;
+    int left;
+    int i;
+    int digits;
+    unsigned long bits;
+
+    new_bitmap(bitmap, 128, 128);
+    font_x = 0;
+    font_y = 0;
+    font_height = 8;
+    encoding = -1;
+    width = height = x_offset = y_offset = 0;
+
+    while(fgets(line, sizeof(line), file) != NULL) {
+        if(sscanf(line, "FONTBOUNDINGBOX %*d %d %d %d", &font_height, &font_x, &font_y) == 3) {
+            continue;
+        }
+
+        if(sscanf(line, "ENCODING %d", &encoding) == 1) continue;
+
+        if(sscanf(line, "BBX %d %d %d %d", &width, &height, &x_offset, &y_offset) == 4) {
+            continue;
+        }
+
+        if(strncmp(line, "BITMAP", 6) != 0) continue;
+
+        // Top line and left column of the glyph in its 8x8 cell
+        top = (font_height + font_y) - (height + y_offset);
+        left = x_offset - font_x;
+
+        for(row = 0; row != height; row++) {
+            if(fgets(line, sizeof(line), file) == NULL) break;
+            if(encoding < 0 || encoding >= GLYPHS) continue;
+
+            // Hexadecimal rows are padded to whole bytes, leftmost bit first
+            bits = strtoul(line, NULL, 16);
+            digits = strspn(line, "0123456789abcdefABCDEF");
+            for(i = 0; i != width && i < digits * 4; i++) {
+                if(!(bits & (1UL << (digits * 4 - 1 - i)))) continue;
+
+                if(left + i < 8 && top + row >= 0 && top + row < 8) {
+                    set_pixel(
+                        bitmap,
+                        (encoding & 15) * 8 + left + i,
+                        (encoding >> 4) * 8 + top + row,
+                        1
+                    );
+                }
+            }
+        }
+
+        encoding = -1;
+    }
+}
+
+// Loads an image or a BDF font, depending on the first bytes of the file.
+static void load_input(const char *path, struct bitmap *bitmap) {
+    FILE *file;
+    char magic[9];
+
+    file = fopen(path, "rb");
+    if(file == NULL) fail("cannot open", path);
+
+    memset(magic, 0, sizeof(magic));
+    if(fread(magic, 1, 8, file) < 2) fail("file too short", path);
+    rewind(file);
+
+    if(strncmp(magic, "STARTFON", 8) == 0) {
+        load_bdf(file, bitmap);
+    } else {
+        load_netpbm(file, bitmap);
+    }
+
+    fclose(file);
+}
+
+// Glyph number g of a glyph image, glyphs being ordered left to right then
+// top to bottom.
+static int glyph_x(const struct bitmap *bitmap, int g) {
+    return (g % (bitmap->width / 8)) * 8;
+}
+
+static int glyph_y(const struct bitmap *bitmap, int g) {
+    return (g / (bitmap->width / 8)) * 8;
+}
+
+static int glyph_count(const struct bitmap *bitmap) {
+    int count;
+
+    count = (bitmap->width / 8) * (bitmap->height / 8);
+    return count > GLYPHS ? GLYPHS : count;
+}
+
+// Doubles each bit of a nibble: 1001 -> 11000011, like double_bits_full.
+static unsigned char double_bits(unsigned char nibble) {
+    unsigned char value;
+    int i;
+
+    value = 0;
+    for(i = 3; i >= 0; i--) value = (value << 2) | ((nibble >> i) & 1) * 3;
+    return value;
+}
+
+// Encodes a bitmap in cell order, shifted right by shift pixels, with extra
+// cells added on the right.
+static void encode_cells(
+    const struct bitmap *bitmap,
+    struct output *output,
+    int shift,
+    int extra
+) {
+    int columns;
+    int row;
+    int col;
+    int line;
+
+    columns = (bitmap->width + 7) / 8 + extra;
+    for(row = 0; row < bitmap->height; row += 8) {
+        for(col = 0; col != columns; col++) {
+            for(line = 0; line != 8; line++) {
+                put_byte(output, get_byte(bitmap, col * 8 - shift, row + line));
+            }
+        }
+    }
+}
+
+static void encode(const char *layout, const struct bitmap *bitmap, struct output *output) {
+    int g;
+    int line;
+    int shift;
+    unsigned char value;
+
+    if(strcmp(layout, "font") == 0 || strcmp(layout, "double") == 0) {
+        for(g = 0; g != glyph_count(bitmap); g++) {
+            for(line = 0; line != 8; line++) {
+                value = get_byte(bitmap, glyph_x(bitmap, g), glyph_y(bitmap, g) + line);
+                if(layout[0] == 'f') {
+                    put_byte(output, value);
+                } else {
+                    put_byte(output, double_bits(value >> 4));
+                }
+            }
+
+            if(layout[0] == 'd') {
+                for(line = 0; line != 8; line++) {
+                    value = get_byte(bitmap, glyph_x(bitmap, g), glyph_y(bitmap, g) + line);
+                    put_byte(output, double_bits(value & 15));
+                }
+            }
+        }
+    } else if(strcmp(layout, "cells") == 0) {
+        encode_cells(bitmap, output, 0, 0);
+    } else if(strcmp(layout, "shifted") == 0) {
+        for(shift = 0; shift != 8; shift++) encode_cells(bitmap, output, shift, 1);
+    } else if(strcmp(layout, "screen") == 0) {
+        if(bitmap->width != 720 || bitmap->height != 256) {
+            fail("a screen image must be 720x256", NULL);
+        }
+
+        // Header record, as written by save_screen()
+        for(g = 0; g != 6; g++) put_byte(output, SCREEN_FILE_MAGIC[g]);
+        put_byte(output, SCREEN_FILE_VERSION);
+        put_byte(output, SCREEN_FILE_RAW);
+        put_byte(output, 90);
+        put_byte(output, 32);
+        while(output->size != SCREEN_FILE_HEADER) put_byte(output, 0);
+
+        encode_cells(bitmap, output, 0, 0);
+    } else {
+        fail("unknown layout", layout);
+    }
+}
+
+// Decodes cells, shifted by shift pixels, back into a bitmap. Pixels set
+// outside the bitmap mean the data does not have this layout.
+static const unsigned char *decode_cells(
+    const unsigned char *data,
+    struct bitmap *bitmap,
+    int shift,
+    int extra
+) {
+    int columns;
+    int row;
+    int col;
+    int line;
+    int x;
+    int i;
+
+    columns = (bitmap->width + 7) / 8 + extra;
+    for(row = 0; row < bitmap->height; row += 8) {
+        for(col = 0; col != columns; col++) {
+            for(line = 0; line != 8; line++) {
+                x = col * 8 - shift;
+                for(i = 0; i != 8; i++) {
+                    if(!(*data & (0x80 >> i))) continue;
+                    if(x + i < 0 || x + i >= bitmap->width
+                       || row + line >= bitmap->height) {
+                        fail("pixels set outside the image", NULL);
+                    }
+                    set_pixel(bitmap, x + i, row + line, 1);
+                }
+                data++;
+            }
+        }
+    }
+
+    return data;
+}
+
+static void decode(
+    const char *layout,
+    const unsigned char *data,
+    size_t size,
+    int width,
+    int height,
+    struct bitmap *bitmap
+) {
+    int g;
+    int line;
+    int i;
+    int glyph_size;
+    unsigned char value;
+    struct bitmap shifted;
+
+    if(strcmp(layout, "font") == 0 || strcmp(layout, "double") == 0) {
+        glyph_size = layout[0] == 'f' ? 8 : 16;
+        new_bitmap(bitmap, 128, ((size / glyph_size + 15) / 16) * 8);
+        for(g = 0; g != (int)(size / glyph_size); g++) {
+            for(line = 0; line != 8; line++) {
+                value = data[g * glyph_size + line];
+                if(glyph_size == 16) {
+                    // Keep one bit out of two of each half
+                    value = 0;
+                    for(i = 0; i != 8; i++) {
+                        value = (value << 1)
+                              | ((data[g * 16 + (i < 4 ? 0 : 8) + line]
+                                  >> (6 - (i & 3) * 2)) & 1);
+                    }
+                }
+                set_byte(bitmap, glyph_x(bitmap, g), glyph_y(bitmap, g) + line, value);
+            }
+        }
+    } else if(strcmp(layout, "cells") == 0) {
+        if(width <= 0 || height <= 0) fail("-w and -h are needed", NULL);
+        new_bitmap(bitmap, width, height);
+        decode_cells(data, bitmap, 0, 0);
+    } else if(strcmp(layout, "shifted") == 0) {
+        if(width <= 0 || height <= 0) fail("-w and -h are needed", NULL);
+        if(size < (size_t)8 * ((width + 7) / 8 + 1) * ((height + 7) / 8) * 8) {
+            fail("not 8 shifted copies of this size", NULL);
+        }
+
+        // Every copy, shifted back, must give the same image as copy 0
+        new_bitmap(bitmap, width, height);
+        new_bitmap(&shifted, width, height);
+        data = decode_cells(data, bitmap, 0, 1);
+        for(i = 1; i != 8; i++) {
+            memset(shifted.pixels, 0, (size_t)width * height);
+            data = decode_cells(data, &shifted, i, 1);
+            if(memcmp(shifted.pixels, bitmap->pixels, (size_t)width * height) != 0) {
+                fprintf(stderr, "pcwconv: shifted copy %d differs from copy 0\n", i);
+                exit(1);
+            }
+        }
+        free(shifted.pixels);
+    } else if(strcmp(layout, "screen") == 0) {
+        if(size < SCREEN_FILE_HEADER + 23040 || memcmp(data, SCREEN_FILE_MAGIC, 6) != 0
+        || data[7] != SCREEN_FILE_RAW) {
+            fail("not a raw screen image", NULL);
+        }
+        new_bitmap(bitmap, 720, 256);
+        decode_cells(data + SCREEN_FILE_HEADER, bitmap, 0, 0);
+    } else {
+        fail("unknown layout", layout);
+    }
+}
+
+static void save_output(const char *path, const char *name, const struct output *output) {
+    FILE *file;
+    size_t i;
+
+    file = fopen(path, "wb");
+    if(file == NULL) fail("cannot create", path);
+
+    if(name == NULL) {
+        fwrite(output->data, 1, output->size, file);
+    } else {
+        fprintf(file, "unsigned char %s[] = {\n", name);
+        for(i = 0; i != output->size; i++) {
+            fprintf(
+                file,
+                "%s0x%02x%s",
+                i % 8 == 0 ? "    " : "",
+                output->data[i],
+                i + 1 == output->size ? "\n" : (i % 8 == 7 ? ",\n" : ", ")
+            );
+        }
+        fprintf(file, "};\n");
+    }
+
+    fclose(file);
+}
+
+static unsigned char *load_binary(const char *path, size_t *size) {
+    FILE *file;
+    unsigned char *data;
+    long length;
+
+    file = fopen(path, "rb");
+    if(file == NULL) fail("cannot open", path);
+
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    rewind(file);
+
+    data = malloc(length + 1);
+    if(data == NULL) fail("out of memory", NULL);
+    *size = fread(data, 1, length, file);
+    fclose(file);
+
+    return data;
+}
+
+int main(int argc, char *argv[]) {
+    const char *layout;
+    const char *name;
+    int decoding;
+    int width;
+    int height;
+    int i;
+    struct bitmap bitmap;
+    struct output output;
+    unsigned char *data;
+    size_t size;
+
+    layout = "font";
+    name = NULL;
+    decoding = 0;
+    width = height = 0;
+
+    for(i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if(strcmp(argv[i], "-d") == 0) {
+            decoding = 1;
+        } else if(i + 1 < argc && strcmp(argv[i], "-l") == 0) {
+            layout = argv[++i];
+        } else if(i + 1 < argc && strcmp(argv[i], "-c") == 0) {
+            name = argv[++i];
+        } else if(i + 1 < argc && strcmp(argv[i], "-w") == 0) {
+            width = atoi(argv[++i]);
+        } else if(i + 1 < argc && strcmp(argv[i], "-h") == 0) {
+            height = atoi(argv[++i]);
+        } else {
+            fail("unknown option", argv[i]);
+        }
+    }
+
+    if(argc - i != 2) {
+        fprintf(
+            stderr,
+            "Usage: pcwconv [-d] [-l font|double|cells|shifted|screen]"
+            " [-c name] [-w width] [-h height] input output\n"
+        );
+        return 1;
+    }
+
+    if(decoding) {
+        data = load_binary(argv[i], &size);
+        decode(layout, data, size, width, height, &bitmap);
+        save_pbm(argv[i + 1], &bitmap);
+    } else {
+        memset(&output, 0, sizeof(output));
+        load_input(argv[i], &bitmap);
+        encode(layout, &bitmap, &output);
+        save_output(argv[i + 1], name, &output);
+    }
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "videoram.h"
+#include "readback.h"
+
+// Characters are read back by finding the glyph of the font whose 8 bytes
+// equal those of the cell. The glyphs are indexed by a hash of their bytes,
+// each byte XORed into the hash rotated left by one bit, so a cell is only
+// compared with the few glyphs of its bucket. Inverting the 8 bytes of a
+// cell XORs its hash with the hash of 8 bytes 0xff, which is 0: an inverse
+// cell falls in the bucket of its glyph and is compared inverted.
+//
+// Only cells printed in normal size without attributes other than
+// ATTR_INVERSE are recognised.
+
+// Font the index was built from
+static unsigned char *indexed_font;
+
+// Glyphs sorted by hash, and for each hash its first glyph and glyph count.
+// Glyphs with the same hash keep the order of their codes.
+static unsigned char index_glyphs[256];
+static unsigned char index_first[256];
+static unsigned char index_count[256];
+
+// Hash of the 8 bytes of a cell.
+static unsigned char cell_hash(const unsigned char *cell) {
+/*
+    unsigned char hash;
+    unsigned char i;
+
+    hash = 0;
+    for(i = 0; i != 8; i++) {
+        hash = ((hash << 1) | (hash >> 7)) ^ cell[i];
+    }
+
+    return hash;
+*/
+#asm
+    ; cell +2
+    pop bc
+    pop hl
+    push hl
+    push bc
+
+    xor a
+    xor (hl)
+    inc hl
+    rlca
+    xor (hl)
+    inc hl
+    rlca
+    xor (hl)
+    inc hl
+    rlca
+    xor (hl)
+    inc hl
+    rlca
+    xor (hl)
+    inc hl
+    rlca
+    xor (hl)
+    inc hl
+    rlca
+    xor (hl)
+    inc hl
+    rlca
+    xor (hl)
+
+    ld l, a
+    ld h, 0
+    ret
+#endasm
+}
+
+// Compare the 8 bytes of a cell, XORed with mask, to a glyph.
+// Returns 1 if they are equal, 0 otherwise.
+static unsigned char same_cell(
+    const unsigned char *cell,
+    const unsigned char *glyph,
+    unsigned char mask
+) {
+/*
+    unsigned char i;
+
+    for(i = 0; i != 8; i++) {
+        if((cell[i] ^ mask) != glyph[i]) return 0;
+    }
+
+    return 1;
+*/
+#asm
+    ; cell +8, glyph +6, mask +4
+    push ix
+    ld ix, 0
+    add ix, sp
+
+    ld l, (ix+8)
+    ld h, (ix+9)
+    ld e, (ix+6)
+    ld d, (ix+7)
+    ld c, (ix+4)
+    ld b, 8
+
+.forloop_sc
+    ld a, (hl)
+    xor c
+    ex de, hl
+    cp (hl)
+    ex de, hl
+    jr nz, differ_sc
+    inc hl
+    inc de
+    djnz forloop_sc
+
+    ld hl, 1
+    pop ix
+    ret
+
+.differ_sc
+    ld hl, 0
+    pop ix
+    ret
+#endasm
+}
+
+// Build the glyph index of a font, the one given to set_font(). It must be
+// built again when the font changes.
+void init_readback(unsigned char *font) {
+    unsigned int c;
+    unsigned char first;
+
+    indexed_font = font;
+    memset(index_count, 0, sizeof(index_count));
+    for(c = 0; c != 256; c++) index_count[cell_hash(font + c * 8)]++;
+
+    first = 0;
+    for(c = 0; c != 256; c++) {
+        index_first[c] = first;
+        first += index_count[c];
+    }
+
+    // Sort the glyphs by hash, advancing the first glyph of each bucket
+    for(c = 0; c != 256; c++) {
+        index_glyphs[index_first[cell_hash(font + c * 8)]++] = c;
+    }
+
+    for(c = 0; c != 256; c++) {
+        index_first[c] -= index_count[c];
+    }
+}
+
+// Find the glyph drawn in a cell, normal or inverse.
+static int find_glyph(const unsigned char *cell) {
+    unsigned char hash;
+    unsigned char count;
+    unsigned char *glyphs;
+
+    hash = cell_hash(cell);
+    glyphs = index_glyphs + index_first[hash];
+    for(count = index_count[hash]; count != 0; count--, glyphs++) {
+        if(same_cell(cell, indexed_font + *glyphs * 8, 0)) return *glyphs;
+    }
+
+    glyphs = index_glyphs + index_first[hash];
+    for(count = index_count[hash]; count != 0; count--, glyphs++) {
+        if(same_cell(cell, indexed_font + *glyphs * 8, 0xff)) {
+            return *glyphs | READ_INVERSE;
+        }
+    }
+
+    return READ_UNKNOWN;
+}
+
+// Returns the character at col, row of the screen, with READ_INVERSE set if
+// it is inverse, or READ_UNKNOWN.
+int get_char_at(unsigned char col, unsigned char row) {
+    return find_glyph(get_screen() + row * SCREEN_WIDTH + col * 8);
+}
+
+// Read the whole screen as text: a line per row of cells, each ending with
+// '\n', the text ending with '\0'. text must hold 32 * 91 + 1 characters.
+// If attributes is not NULL, it receives ATTR_INVERSE or ATTR_NONE for each
+// of the 32 * 90 cells, row after row.
+void read_screen_text(unsigned char *text, unsigned char *attributes) {
+    unsigned char col;
+    unsigned char row;
+    unsigned char *cell;
+    int c;
+
+    cell = get_screen();
+    for(row = 0; row != SCREEN_HEIGHT / 8; row++) {
+        for(col = 0; col != SCREEN_WIDTH / 8; col++, cell += 8) {
+            c = find_glyph(cell);
+            if(c == READ_UNKNOWN) {
+                *text++ = READ_UNKNOWN_CHAR;
+                if(attributes != NULL) *attributes++ = READ_UNKNOWN_ATTR;
+            } else {
+                *text++ = c;
+                if(attributes != NULL) {
+                    *attributes++ = (c & READ_INVERSE) ? ATTR_INVERSE : ATTR_NONE;
+                }
+            }
+        }
+        *text++ = '\n';
+    }
+
+    *text = '\0';
+}
@@ -0,0 +1,18 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+// get_char_at() returns the character code, with READ_INVERSE set for an
+// inverse cell, or READ_UNKNOWN when the cell matches no glyph of the font.
+#define READ_INVERSE 0x100
+#define READ_UNKNOWN -1
+
+// read_screen_text() puts READ_UNKNOWN_CHAR in the text for unknown cells,
+// and READ_UNKNOWN_ATTR in their attribute.
+#define READ_UNKNOWN_CHAR '?'
+#define READ_UNKNOWN_ATTR 0x80
+
+extern void init_readback(unsigned char *font);
+extern int get_char_at(unsigned char col, unsigned char row);
+extern void read_screen_text(unsigned char *text, unsigned char *attributes);
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <string.h>
+#include "videoram.h"
+#include "cpmfile.h"
+#include "screenfile.h"
+
+// Header record of a screen image file.
+struct screen_header {
+    unsigned char magic[6];     // SCREEN_FILE_MAGIC
+    unsigned char version;      // SCREEN_FILE_VERSION
+    unsigned char compression;  // SCREEN_FILE_RAW or SCREEN_FILE_RLE
+    unsigned char columns;      // 90
+    unsigned char rows;         // 32
+};
+
+// Buffer for the header record and for RLE compressed records. Raw images are
+// read and written directly from the screen memory.
+static unsigned char record[RECORD_SIZE];
+
+// File being read or written.
+static struct cpm_fcb fcb;
+
+// Number of bytes in record while writing an RLE image.
+static unsigned char record_fill;
+
+// Create a screen image file and write its header record.
+static unsigned char create_screen_file(
+    const char *filename,
+    unsigned char compression
+) {
+    struct screen_header *header;
+
+    if(!fcb_create(&fcb, filename)) return 0;
+
+    memset(record, 0, RECORD_SIZE);
+    header = (struct screen_header *)record;
+    memcpy(header->magic, SCREEN_FILE_MAGIC, 6);
+    header->version = SCREEN_FILE_VERSION;
+    header->compression = compression;
+    header->columns = 90;
+    header->rows = 32;
+
+    return fcb_write(&fcb, record);
+}
+
+// Save the screen memory as is, 180 records written directly from the screen.
+// Returns 0 on error, 1 otherwise.
+unsigned char save_screen(const char *filename) {
+    unsigned char *address;
+    unsigned char ok;
+
+    if(!create_screen_file(filename, SCREEN_FILE_RAW)) return 0;
+
+    ok = 1;
+    address = get_screen();
+    for(; ok && address != get_screen() + SCREEN_SIZE; address += RECORD_SIZE) {
+        ok = fcb_write(&fcb, address);
+    }
+
+    fcb_close(&fcb);
+    return ok;
+}
+
+// Add a byte to the RLE record, writing the record once full.
+static unsigned char put_rle_byte(unsigned char value) {
+    record[record_fill++] = value;
+    if(record_fill != RECORD_SIZE) return 1;
+
+    record_fill = 0;
+    return fcb_write(&fcb, record);
+}
+
+// Save the screen memory compressed with PackBits RLE: a control byte n from
+// 0 to 127 is followed by n + 1 literal bytes, a control byte n from 129 to 255
+// is followed by one byte to repeat 257 - n times, 128 is ignored.
+// Returns 0 on error, 1 otherwise.
+unsigned char save_screen_rle(const char *filename) {
+    unsigned char *current;
+    unsigned char *end;
+    unsigned char *scan;
+    unsigned char count;
+    unsigned char ok;
+
+    if(!create_screen_file(filename, SCREEN_FILE_RLE)) return 0;
+
+    ok = 1;
+    record_fill = 0;
+    current = get_screen();
+    end = current + SCREEN_SIZE;
+    while(ok && current != end) {
+        // Repeated bytes
+        for(count = 1; count != 128; count++) {
+            if(current + count == end || current[count] != *current) break;
+        }
+
+        if(count >= 3) {
+            ok = put_rle_byte(257 - count) && put_rle_byte(*current);
+            current += count;
+            continue;
+        }
+
+        // Literal bytes, up to the next run of 3 repeated bytes
+        scan = current;
+        for(count = 0; count != 128 && scan != end; count++, scan++) {
+            if(scan + 2 < end && scan[0] == scan[1] && scan[1] == scan[2]) {
+                break;
+            }
+        }
+
+        ok = put_rle_byte(count - 1);
+        for(; ok && current != scan; current++) ok = put_rle_byte(*current);
+    }
+
+    // Complete the last record with ignored control bytes
+    while(ok && record_fill != 0) ok = put_rle_byte(128);
+
+    fcb_close(&fcb);
+    return ok;
+}
+
+// Decompress RLE records directly into the screen memory as they are read.
+static unsigned char load_screen_rle() {
+    unsigned char *current;
+    unsigned char *end;
+    unsigned char run;
+    unsigned char repeat;
+    unsigned char value;
+    unsigned char i;
+
+    current = get_screen();
+    end = current + SCREEN_SIZE;
+    run = 0;
+    repeat = 0;
+    while(current != end) {
+        if(!fcb_read(&fcb, record)) return 0;
+
+        for(i = 0; i != RECORD_SIZE; i++) {
+            value = record[i];
+            if(repeat) {
+                // Do not go past the screen memory on corrupted files
+                if(end - current < run) run = end - current;
+                memset(current, value, run);
+                current += run;
+                run = 0;
+                repeat = 0;
+            } else if(run != 0) {
+                if(current != end) *current++ = value;
+                run--;
+            } else if(value < 128) {
+                run = value + 1;
+            } else if(value != 128) {
+                run = 257 - value;
+                repeat = 1;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// Load a screen image saved by save_screen() or save_screen_rle(). Raw images
+// are read record by record directly into the screen memory.
+// Returns 0 on error, 1 otherwise.
+unsigned char load_screen(const char *filename) {
+    struct screen_header *header;
+    unsigned char *address;
+    unsigned char ok;
+
+    if(!fcb_open(&fcb, filename)) return 0;
+
+    header = (struct screen_header *)record;
+    ok = fcb_read(&fcb, record)
+      && memcmp(header->magic, SCREEN_FILE_MAGIC, 6) == 0
+      && header->version == SCREEN_FILE_VERSION;
+
+    if(ok && header->compression == SCREEN_FILE_RLE) {
+        ok = load_screen_rle();
+    } else if(ok) {
+        address = get_screen();
+        for(; ok && address != get_screen() + SCREEN_SIZE; address += RECORD_SIZE) {
+            ok = fcb_read(&fcb, address);
+        }
+    }
+
+    fcb_close(&fcb);
+    return ok;
+}
@@ -0,0 +1,16 @@
+#ifndef SCREENFILE_H
+#define SCREENFILE_H
+
+// Screen image file: a 128 bytes header record followed by the screen memory
+// in its native cell order, either raw (180 records) or RLE compressed.
+#define SCREEN_FILE_MAGIC "PCWSCR"
+#define SCREEN_FILE_VERSION 1
+
+#define SCREEN_FILE_RAW 0
+#define SCREEN_FILE_RLE 1
+
+extern unsigned char save_screen(const char *filename);
+extern unsigned char save_screen_rle(const char *filename);
+extern unsigned char load_screen(const char *filename);
+
+#endif
@@ -0,0 +1,211 @@
+// Host test of console.c: random text and page moves are checked against a
+// model of the lines printed. The screen functions are replaced by a target
+// of cells holding the character and attributes printed there. console.c is
+// included to see the lines kept and how far the view is scrolled back.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "videoram.h"
+#include "arena.h"
+#include "console.c"
+
+#define TOP 4
+#define ROWS 10
+#define MAX_LINES 20000
+
+static unsigned char cells[32 * 90 * 8];
+static struct canvas target = {cells, NULL, 720, 90, 32};
+static unsigned char cursor_col;
+static unsigned char cursor_row;
+static unsigned char attributes;
+static int failures;
+
+// Model of the lines printed, the last one being printed
+static char lines[MAX_LINES][CONSOLE_COLUMNS + 1];
+static unsigned char line_attributes[MAX_LINES];
+static int line_count;
+
+static void check(int condition, const char *what) {
+    if(condition) return;
+    fprintf(stderr, "console_test: %s\n", what);
+    failures++;
+}
+
+struct canvas *get_target() {
+    return &target;
+}
+
+unsigned char *cell_address(unsigned char col, unsigned char row) {
+    return target.buffer + row * target.stride + col * 8;
+}
+
+void locate(unsigned char col, unsigned char row) {
+    cursor_col = col;
+    cursor_row = row;
+}
+
+// Each cell gets the character and the attributes, 0 is a blank cell.
+void print(const unsigned char *string) {
+    unsigned char *cell;
+
+    for(; *string != '\0' && cursor_col < target.columns; string++) {
+        cell = cell_address(cursor_col++, cursor_row);
+        cell[0] = *string;
+        cell[1] = attributes | 0x80;
+    }
+}
+
+void set_attributes(unsigned char value) {
+    attributes = value;
+}
+
+unsigned char get_attributes() {
+    return attributes;
+}
+
+void copy_rect(
+    unsigned char src_col,
+    unsigned char src_row,
+    unsigned char width,
+    unsigned char height,
+    unsigned char dst_col,
+    unsigned char dst_row
+) {
+    unsigned char row;
+
+    for(row = 0; row != height; row++) {
+        memmove(
+            cell_address(dst_col, dst_row + row),
+            cell_address(src_col, src_row + row),
+            width * 8
+        );
+    }
+}
+
+void *arena_alloc(unsigned int size) {
+    return malloc(size);
+}
+
+// Print text on the console and in the model.
+static void print_text(const char *text, unsigned char text_attributes) {
+    char *line;
+
+    console_attributes(text_attributes);
+    console_print((const unsigned char *)text);
+
+    for(; *text != '\0'; text++) {
+        line = lines[line_count];
+        if(*text == '\n' || strlen(line) == target.columns) {
+            line_count++;
+            if(*text == '\n') continue;
+            line = lines[line_count];
+        }
+
+        if(line[0] == '\0') line_attributes[line_count] = text_attributes;
+        strncat(line, text, 1);
+    }
+}
+
+// Compare the window with the model.
+static void check_window(const char *what) {
+    unsigned char row;
+    unsigned char col;
+    unsigned char *cell;
+    int index;
+    int dropped;
+    char expected;
+    char message[80];
+    int same;
+    int blank;
+
+    dropped = line_count - console.lines;
+    for(row = 0; row != ROWS; row++) {
+        index = line_count - console.back - (ROWS - 1) + row;
+
+        same = 1;
+        blank = 1;
+        for(col = 0; col != target.columns; col++) {
+            cell = cell_address(col, TOP + row);
+            expected = index >= 0 && col < strlen(lines[index])
+                     ? lines[index][col]
+                     : 0;
+
+            if(cell[0] != 0) blank = 0;
+            if(cell[0] != expected) same = 0;
+            if(expected != 0 && cell[1] != (line_attributes[index] | 0x80)) {
+                same = 0;
+            }
+        }
+
+        // Rows above the oldest line kept are blank
+        if(index < dropped && blank) continue;
+
+        sprintf(message, "%s: row %d, line %d", what, row, index);
+        check(same, message);
+    }
+}
+
+// Print random text and move the view at random, checking the window after
+// each step.
+static void run(unsigned int history, unsigned char columns, int seed) {
+    char text[300];
+    char what[40];
+    int length;
+    int step;
+    int i;
+    int old_failures;
+
+    target.columns = columns;
+    target.stride = columns * 8;
+    memset(cells, 0, sizeof(cells));
+    memset(lines, 0, sizeof(lines));
+    line_count = 0;
+    srand(seed);
+
+    check(init_console(history, TOP, ROWS), "init_console() failed");
+
+    old_failures = failures;
+    for(step = 0; step != 3000 && failures == old_failures; step++) {
+        switch(rand() % 10) {
+        case 0: case 1: case 2: case 3: case 4: case 5:
+            length = rand() % (rand() % 3 ? 40 : 200);
+            for(i = 0; i != length; i++) {
+                text[i] = rand() % 8 == 0 ? '\n' : 'a' + rand() % 26;
+            }
+            text[length] = '\0';
+            print_text(text, rand() % 4 == 0);
+            break;
+
+        case 6: case 7:
+            console_page_up();
+            break;
+
+        default:
+            console_page_down();
+            break;
+        }
+
+        sprintf(what, "history %u, columns %d, step %d", history, columns, step);
+        check_window(what);
+    }
+
+    // The attributes of the program are kept
+    set_attributes(6);
+    print_text("xy", 0);
+    console_page_up();
+    console_page_down();
+    print_text("z\n", 1);
+    check(get_attributes() == 6, "attributes not restored");
+}
+
+int main() {
+    run(2000, 90, 1);
+    run(200, 90, 2);
+    run(30000, 90, 3);
+    run(1000, 40, 4);
+
+    if(failures != 0) return 1;
+    printf("console_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,212 @@
+// Host test of diskload.c: files are written to a raw disc image built here,
+// then read back through the loader.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpmfile.h"
+#include "diskload.h"
+
+#define IMAGE_PATH "diskload_test.img"
+#define IMAGE_SIZE (200 * 1024)
+
+// 128 bytes sectors, 36 per track, 2k blocks: a contiguous file is read as
+// runs of more than 255 sectors
+static const struct dpb small_sectors_dpb = {
+    36, 4, 15, 1, 200, 63, 0xc000, 16, 1, 0, 0
+};
+
+static unsigned char image[IMAGE_SIZE];
+static unsigned char loaded[65536];
+static int failures;
+
+static void check(int condition, const char *what) {
+    if(condition) return;
+    fprintf(stderr, "diskload_test: %s\n", what);
+    failures++;
+}
+
+// Byte of a file at an offset, different for each file.
+static unsigned char file_byte(unsigned char seed, long offset) {
+    return (unsigned char)(offset * 7 + (offset >> 8) + seed * 31);
+}
+
+// Start an empty disc image.
+static void new_image() {
+    memset(image, 0xe5, IMAGE_SIZE);
+}
+
+// Byte offset of a block in the image.
+static long block_offset(const struct dpb *dpb, unsigned int block) {
+    return (long)dpb->reserved_tracks * dpb->records_per_track * RECORD_SIZE
+         + ((long)block << dpb->block_shift) * RECORD_SIZE;
+}
+
+// Write a file of records records in the blocks given, its directory entries
+// starting at entry.
+static void add_file(
+    const struct dpb *dpb,
+    const char *name,
+    unsigned char seed,
+    unsigned int records,
+    const unsigned int *blocks,
+    unsigned int entry
+) {
+    unsigned int per_block;
+    unsigned int per_entry;
+    unsigned int block_count;
+    unsigned int first;
+    unsigned int end;
+    unsigned int extent;
+    unsigned int i;
+    unsigned char *directory;
+    struct cpm_fcb fcb;
+    long offset;
+
+    per_block = 1 << dpb->block_shift;
+    per_entry = dpb->nb_disk_blocks < 256 ? 16 : 8;
+    block_count = (records + per_block - 1) / per_block;
+
+    // Contents
+    for(i = 0; i != records * RECORD_SIZE; i++) {
+        offset = block_offset(dpb, blocks[i / (per_block * RECORD_SIZE)])
+               + i % (per_block * RECORD_SIZE);
+        image[offset] = file_byte(seed, i);
+    }
+
+    // One directory entry per per_entry blocks
+    fcb_set_name(&fcb, name);
+    for(first = 0; first < block_count; first += per_entry, entry++) {
+        directory = image + block_offset(dpb, 0) + entry * 32;
+        memset(directory, 0, 32);
+        memcpy(directory + 1, fcb.name, 11);
+
+        end = (first + per_entry) * per_block;
+        if(end > records) end = records;
+        extent = (end - 1) / 128;
+        directory[12] = extent & 0x1f;
+        directory[14] = extent >> 5;
+        directory[15] = (end - 1) % 128 + 1;
+
+        for(i = 0; i != per_entry && first + i < block_count; i++) {
+            if(per_entry == 16) {
+                directory[16 + i] = blocks[first + i];
+            } else {
+                directory[16 + i * 2] = blocks[first + i] & 0xff;
+                directory[17 + i * 2] = blocks[first + i] >> 8;
+            }
+        }
+    }
+}
+
+static void write_image(const struct dpb *dpb) {
+    FILE *file;
+
+    file = fopen(IMAGE_PATH, "wb");
+    if(file == NULL || fwrite(image, 1, IMAGE_SIZE, file) != IMAGE_SIZE) {
+        fprintf(stderr, "diskload_test: cannot write %s\n", IMAGE_PATH);
+        exit(1);
+    }
+    fclose(file);
+
+    check(disk_image(IMAGE_PATH, dpb), "disk_image() failed");
+}
+
+// Returns 1 if count bytes of a file from offset are at address.
+static int same_bytes(
+    const unsigned char *address,
+    unsigned char seed,
+    long offset,
+    long count
+) {
+    long i;
+
+    for(i = 0; i != count; i++) {
+        if(address[i] != file_byte(seed, offset + i)) return 0;
+    }
+
+    return 1;
+}
+
+// A file of 16 contiguous blocks, read as runs longer than 255 sectors.
+static void test_long_runs() {
+    unsigned int blocks[16];
+    unsigned int i;
+
+    new_image();
+    for(i = 0; i != 16; i++) blocks[i] = 2 + i;
+    add_file(&small_sectors_dpb, "LONG.BIN", 1, 256, blocks, 0);
+    write_image(&small_sectors_dpb);
+
+    check(load_file("LONG.BIN", loaded, 32768) == 32768, "long runs: size");
+    check(same_bytes(loaded, 1, 0, 32768), "long runs: contents");
+}
+
+// Fragmented files of the CF2 format, ending with a partial sector.
+static void test_fragmented() {
+    static const unsigned int blocks[] = {
+        5, 6, 7, 20, 21, 9, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 60, 61
+    };
+    static const unsigned int other_blocks[] = {70, 8};
+    unsigned int records;
+    unsigned int record;
+    unsigned int count;
+    unsigned int i;
+    struct disk_file file;
+
+    records = 18 * 8 + 5;
+
+    new_image();
+    add_file(&pcw_cf2_dpb, "FRAG.DAT", 2, records, blocks, 0);
+    add_file(&pcw_cf2_dpb, "OTHER", 3, 10, other_blocks, 3);
+    write_image(&pcw_cf2_dpb);
+
+    check(load_file("FRAG.DAT", loaded, 65535) == records * RECORD_SIZE,
+          "fragmented: size");
+    check(same_bytes(loaded, 2, 0, records * RECORD_SIZE),
+          "fragmented: contents");
+
+    // Loading stops at size, in whole records
+    memset(loaded, 0, 1024);
+    check(load_file("FRAG.DAT", loaded, 700) == 5 * RECORD_SIZE,
+          "fragmented: limited size");
+    check(same_bytes(loaded, 2, 0, 5 * RECORD_SIZE), "fragmented: limited contents");
+    check(loaded[5 * RECORD_SIZE] == 0, "fragmented: loaded past size");
+
+    check(load_file("OTHER", loaded, 65535) == 10 * RECORD_SIZE, "other: size");
+    check(same_bytes(loaded, 3, 0, 10 * RECORD_SIZE), "other: contents");
+
+    // Records read at random
+    check(find_file("FRAG.DAT", &file) == 1, "find_file() failed");
+    check(file.records == records, "find_file(): records");
+    srand(1);
+    for(i = 0; i != 200; i++) {
+        record = rand() % records;
+        count = 1 + rand() % 20;
+        if(record + count > records) count = records - record;
+
+        check(read_file_records(&file, record, count, loaded), "read_file_records() failed");
+        check(same_bytes(loaded, 2, (long)record * RECORD_SIZE, (long)count * RECORD_SIZE),
+              "read_file_records(): contents");
+    }
+
+    check(load_file("MISSING", loaded, 65535) == 0, "missing file found");
+}
+
+// A drive which cannot be read is reported as such.
+static void test_read_error() {
+    check(disk_image(".", &pcw_cf2_dpb), "disk_image() of a directory failed");
+    check(load_file("FRAG.DAT", loaded, 65535) == DISK_LOAD_ERROR,
+          "read error not reported");
+}
+
+int main() {
+    test_long_runs();
+    test_fragmented();
+    test_read_error();
+    remove(IMAGE_PATH);
+
+    if(failures != 0) return 1;
+    printf("diskload_test: ok\n");
+    return 0;
+}
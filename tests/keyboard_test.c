@@ -0,0 +1,128 @@
+// Host test of keyboard.c: keys are pressed and released in the stand-in
+// matrix between scans.
+
+#include <stdio.h>
+#include <string.h>
+#include "keyboard.h"
+
+static int failures;
+
+static void check(int condition, const char *what) {
+    if(condition) return;
+    fprintf(stderr, "keyboard_test: %s\n", what);
+    failures++;
+}
+
+static void set_key(unsigned char key, unsigned char down) {
+    if(down) {
+        key_host_matrix[key >> 3] |= 1 << (key & 7);
+    } else {
+        key_host_matrix[key >> 3] &= ~(1 << (key & 7));
+    }
+}
+
+// Keys down at start are part of the state without events.
+static void test_init() {
+    memset(key_host_matrix, 0, KEY_ROWS);
+    set_key(KEY_CODE(2, 5), 1);
+    key_init();
+
+    check(key_down(KEY_CODE(2, 5)), "init: key not down");
+    check(key_event() == KEY_NONE, "init: event queued");
+
+    key_scan();
+    key_scan();
+    check(key_event() == KEY_NONE, "init: event after scans");
+}
+
+// A change is only accepted when read by two scans in a row.
+static void test_debounce() {
+    unsigned char key;
+
+    memset(key_host_matrix, 0, KEY_ROWS);
+    key_init();
+    key = KEY_CODE(7, 3);
+
+    // Bounce: down for a single scan
+    set_key(key, 1);
+    key_scan();
+    set_key(key, 0);
+    key_scan();
+    key_scan();
+    check(!key_down(key), "bounce: key down");
+    check(key_event() == KEY_NONE, "bounce: event queued");
+
+    // Press
+    set_key(key, 1);
+    key_scan();
+    check(!key_down(key), "press: down after one scan");
+    key_scan();
+    check(key_down(key), "press: not down after two scans");
+    check(key_event() == (key | KEY_PRESSED), "press: no press event");
+    check(key_event() == KEY_NONE, "press: extra event");
+
+    // Release
+    set_key(key, 0);
+    key_scan();
+    key_scan();
+    check(!key_down(key), "release: still down");
+    check(key_event() == key, "release: no release event");
+    check(key_event() == KEY_NONE, "release: extra event");
+}
+
+// Keys changed together are queued in key code order.
+static void test_chord() {
+    memset(key_host_matrix, 0, KEY_ROWS);
+    key_init();
+
+    set_key(KEY_CODE(8, 1), 1);
+    set_key(KEY_CODE(0, 0), 1);
+    set_key(KEY_CODE(10, 7), 1);
+    key_scan();
+    key_scan();
+
+    check(key_event() == (KEY_CODE(0, 0) | KEY_PRESSED), "chord: first event");
+    check(key_event() == (KEY_CODE(8, 1) | KEY_PRESSED), "chord: second event");
+    check(key_event() == (KEY_CODE(10, 7) | KEY_PRESSED), "chord: third event");
+    check(key_event() == KEY_NONE, "chord: extra event");
+    check(key_state()[8] == 0x02, "chord: state");
+}
+
+// Events past a full queue are dropped, the state is still updated.
+static void test_overflow() {
+    unsigned char key;
+    unsigned char i;
+
+    memset(key_host_matrix, 0, KEY_ROWS);
+    key_init();
+
+    for(key = 0; key != KEY_COUNT; key++) set_key(key, 1);
+    key_scan();
+    key_scan();
+
+    for(i = 0; i != KEY_QUEUE_SIZE - 1; i++) {
+        check(key_event() == (i | KEY_PRESSED), "overflow: queued event");
+    }
+    check(key_event() == KEY_NONE, "overflow: event past queue size");
+
+    for(key = 0; key != KEY_COUNT; key++) {
+        check(key_down(key), "overflow: key not down");
+    }
+
+    // The queue works again once read
+    set_key(KEY_CODE(4, 4), 0);
+    key_scan();
+    key_scan();
+    check(key_event() == KEY_CODE(4, 4), "overflow: event after reading");
+}
+
+int main() {
+    test_init();
+    test_debounce();
+    test_chord();
+    test_overflow();
+
+    if(failures != 0) return 1;
+    printf("keyboard_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+// Host test of screenfile.c: screens are saved and loaded back through a file
+// kept in memory in place of the CP/M file functions.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "videoram.h"
+#include "cpmfile.h"
+#include "screenfile.h"
+
+#define FILE_RECORDS 256
+
+static unsigned char screen[SCREEN_SIZE];
+static unsigned char saved[SCREEN_SIZE];
+static int failures;
+
+// Single file in memory, written and read record by record.
+static unsigned char file_data[FILE_RECORDS * RECORD_SIZE];
+static unsigned int file_records;
+static unsigned int file_position;
+
+static void check(int condition, const char *what) {
+    if(condition) return;
+    fprintf(stderr, "screenfile_test: %s\n", what);
+    failures++;
+}
+
+unsigned char *get_screen() {
+    return screen;
+}
+
+unsigned char fcb_create(struct cpm_fcb *fcb, const char *filename) {
+    fcb_set_name(fcb, filename);
+    file_records = 0;
+    file_position = 0;
+    return 1;
+}
+
+unsigned char fcb_open(struct cpm_fcb *fcb, const char *filename) {
+    fcb_set_name(fcb, filename);
+    file_position = 0;
+    return 1;
+}
+
+unsigned char fcb_read(struct cpm_fcb *fcb, unsigned char *address) {
+    (void)fcb;
+    if(file_position == file_records) return 0;
+    memcpy(address, file_data + file_position++ * RECORD_SIZE, RECORD_SIZE);
+    return 1;
+}
+
+unsigned char fcb_write(struct cpm_fcb *fcb, unsigned char *address) {
+    (void)fcb;
+    if(file_records == FILE_RECORDS) return 0;
+    memcpy(file_data + file_records++ * RECORD_SIZE, address, RECORD_SIZE);
+    return 1;
+}
+
+void fcb_close(struct cpm_fcb *fcb) {
+    (void)fcb;
+}
+
+// Save the screen, clear it, load it back and compare.
+static void round_trip(const char *what, unsigned char rle) {
+    char message[80];
+
+    memcpy(saved, screen, SCREEN_SIZE);
+
+    sprintf(message, "%s: save failed", what);
+    check(rle ? save_screen_rle("TEST.SCR") : save_screen("TEST.SCR"), message);
+
+    memset(screen, 0x55, SCREEN_SIZE);
+    sprintf(message, "%s: load failed", what);
+    check(load_screen("TEST.SCR"), message);
+
+    sprintf(message, "%s: different screen", what);
+    check(memcmp(screen, saved, SCREEN_SIZE) == 0, message);
+}
+
+// Fill the screen with one of the test patterns.
+static void fill_screen(int pattern) {
+    int i;
+
+    srand(pattern);
+    for(i = 0; i != SCREEN_SIZE; i++) {
+        switch(pattern) {
+        case 0: screen[i] = 0; break;
+        case 1: screen[i] = rand(); break;
+        case 2: screen[i] = (i / 3) & 1 ? 0xff : 0x00; break;
+        case 3: screen[i] = i % 131 < 129 ? 0xaa : i; break;
+        case 4: screen[i] = rand() % 4 == 0 ? rand() : 0; break;
+        default: screen[i] = i & 2 ? i : 0x18; break;
+        }
+    }
+}
+
+int main() {
+    char what[40];
+    unsigned char *header;
+    int pattern;
+
+    for(pattern = 0; pattern != 6; pattern++) {
+        fill_screen(pattern);
+        sprintf(what, "raw pattern %d", pattern);
+        round_trip(what, 0);
+        check(file_records == 181, "raw image size");
+
+        fill_screen(pattern);
+        sprintf(what, "rle pattern %d", pattern);
+        round_trip(what, 1);
+    }
+
+    // A blank screen is the header and 180 runs of 128 bytes
+    fill_screen(0);
+    round_trip("rle blank", 1);
+    check(file_records <= 4, "blank rle image size");
+
+    // Truncated images and other files are rejected
+    fill_screen(1);
+    round_trip("rle truncated", 1);
+    file_records--;
+    check(!load_screen("TEST.SCR"), "truncated rle image loaded");
+
+    header = file_data;
+    header[0] = 'X';
+    check(!load_screen("TEST.SCR"), "bad magic loaded");
+
+    if(failures != 0) return 1;
+    printf("screenfile_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "videoram.h"
+#include "arena.h"
+#include "tilemap.h"
+
+// A tile map is drawn in a window of the screen, row of cells by row of
+// cells, so the map, the shadow buffer and the screen memory are all read
+// and written in increasing addresses. The shadow buffer keeps the index of
+// the tile drawn in each cell of the window: a cell is only drawn again when
+// the tile the map gives it differs, whether the map changed or the camera
+// moved.
+
+// Tile set of the map being drawn, for draw_row()
+static unsigned char *tileset;
+
+// Set up a tile map shown in a window of columns x rows cells whose top left
+// corner is at col, row. The map must be at least as large as the window.
+// The shadow buffer is taken from the arena.
+// Returns 0 if there is not enough memory, 1 otherwise.
+unsigned char init_tilemap(
+    struct tilemap *tilemap,
+    unsigned char *map,
+    unsigned char width,
+    unsigned char height,
+    unsigned char *tiles,
+    unsigned char col,
+    unsigned char row,
+    unsigned char columns,
+    unsigned char rows
+) {
+    tilemap->map = map;
+    tilemap->width = width;
+    tilemap->height = height;
+    tilemap->tiles = tiles;
+    tilemap->camera_col = 0;
+    tilemap->camera_row = 0;
+    tilemap->col = col;
+    tilemap->row = row;
+    tilemap->columns = columns;
+    tilemap->rows = rows;
+    tilemap->invalid = 1;
+    tilemap->shown = arena_alloc(columns * rows);
+
+    return tilemap->shown != NULL;
+}
+
+// Redraw the whole window at the next rendering, when something else has
+// been drawn over it.
+void tilemap_invalidate(struct tilemap *tilemap) {
+    tilemap->invalid = 1;
+}
+
+// Change a tile of the map. It is drawn at the next rendering if visible.
+void tilemap_set(struct tilemap *tilemap, unsigned char x, unsigned char y, unsigned char tile) {
+    tilemap->map[y * tilemap->width + x] = tile;
+}
+
+// Move the camera to show the map from col, row. The camera stops at the
+// edges of the map.
+void tilemap_camera(struct tilemap *tilemap, unsigned char col, unsigned char row) {
+    if(col > tilemap->width - tilemap->columns) {
+        col = tilemap->width - tilemap->columns;
+    }
+
+    if(row > tilemap->height - tilemap->rows) {
+        row = tilemap->height - tilemap->rows;
+    }
+
+    tilemap->camera_col = col;
+    tilemap->camera_row = row;
+}
+
+// Draw count cells of a row whose tile differs from the shadow buffer, and
+// update the shadow buffer. Returns the number of cells drawn.
+static unsigned char draw_row(
+    unsigned char *map,
+    unsigned char *shown,
+    unsigned char *address,
+    unsigned char count
+) {
+/*
+    unsigned char drawn;
+
+    for(drawn = 0; count != 0; count--, map++, shown++, address += 8) {
+        if(*map == *shown) continue;
+        *shown = *map;
+        memcpy(address, &tileset[*map * 8], 8);
+        drawn++;
+    }
+
+    return drawn;
+*/
+#asm
+    ; map +10, shown +8, address +6, count +4
+    ; drawn -2, count -1
+    push ix
+    ld ix, 0
+    add ix, sp
+
+    ld b, (ix+4)
+    ld c, 0
+    push bc
+    push iy
+
+    ld l, (ix+8) ; shown
+    ld h, (ix+9)
+    push hl
+    pop iy
+    ld e, (ix+6) ; address
+    ld d, (ix+7)
+    ld l, (ix+10) ; map
+    ld h, (ix+11)
+
+.forloop_dr
+    ; if(*map == *shown) continue;
+    ld a, (hl)
+    cp (iy+0)
+    jr z, skip_dr
+
+    ; *shown = *map;
+    ld (iy+0), a
+
+    ; memcpy(address, &tileset[*map * 8], 8);
+    push hl
+    ld l, a
+    ld h, 0
+    add hl, hl
+    add hl, hl
+    add hl, hl
+    ld bc, (_tileset)
+    add hl, bc
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    pop hl
+
+    ; drawn++
+    inc (ix-2)
+    jr next_dr
+
+.skip_dr
+    ; address += 8
+    ld a, e
+    add 8
+    ld e, a
+    jr nc, next_dr
+    inc d
+
+.next_dr
+    inc hl
+    inc iy
+    dec (ix-1)
+    jr nz, forloop_dr
+
+    pop iy
+    pop hl
+    ld h, 0
+    pop ix
+    ret
+#endasm
+}
+
+// Draw the cells of the window whose tile changed since the last rendering.
+// Returns the number of cells drawn.
+unsigned int tilemap_render(struct tilemap *tilemap) {
+    unsigned char r;
+    unsigned char c;
+    unsigned int drawn;
+    unsigned char *map;
+    unsigned char *shown;
+
+    if(tilemap->columns == 0) return 0;
+
+    map = tilemap->map
+        + tilemap->camera_row * tilemap->width
+        + tilemap->camera_col;
+
+    // Make every cell differ from the map
+    if(tilemap->invalid) {
+        shown = tilemap->shown;
+        for(r = 0; r != tilemap->rows; r++) {
+            for(c = 0; c != tilemap->columns; c++) {
+                *shown++ = map[c] ^ 1;
+            }
+            map += tilemap->width;
+        }
+
+        map -= tilemap->rows * tilemap->width;
+        tilemap->invalid = 0;
+    }
+
+    tileset = tilemap->tiles;
+    shown = tilemap->shown;
+    drawn = 0;
+    for(r = 0; r != tilemap->rows; r++) {
+        drawn += draw_row(
+            map,
+            shown,
+            cell_address(tilemap->col, tilemap->row + r),
+            tilemap->columns
+        );
+        map += tilemap->width;
+        shown += tilemap->columns;
+    }
+
+    return drawn;
+}
@@ -0,0 +1,36 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+// A map of tiles shown through a window of the screen
+struct tilemap {
+    unsigned char *map;         // Tile indices, row after row
+    unsigned char width;        // Map width in tiles
+    unsigned char height;       // Map height in tiles
+    unsigned char *tiles;       // Tile set, 8 bytes per tile like a font
+    unsigned char camera_col;   // Map position shown at the top left corner
+    unsigned char camera_row;
+    unsigned char col;          // Window showing the map, in cells
+    unsigned char row;
+    unsigned char columns;
+    unsigned char rows;
+    unsigned char *shown;       // Tile index drawn in each cell of the window
+    unsigned char invalid;      // Set when the window must be fully redrawn
+};
+
+extern unsigned char init_tilemap(
+    struct tilemap *tilemap,
+    unsigned char *map,
+    unsigned char width,
+    unsigned char height,
+    unsigned char *tiles,
+    unsigned char col,
+    unsigned char row,
+    unsigned char columns,
+    unsigned char rows
+);
+extern void tilemap_invalidate(struct tilemap *tilemap);
+extern void tilemap_set(struct tilemap *tilemap, unsigned char x, unsigned char y, unsigned char tile);
+extern void tilemap_camera(struct tilemap *tilemap, unsigned char col, unsigned char row);
+extern unsigned int tilemap_render(struct tilemap *tilemap);
+
+#endif
@@ -3,6 +3,7 @@
 #include <strings.h>
 #include "videoram.h"
 #include "characters.h"
+#include "arena.h"
 
 // Look up table: transforms 4 bits to 8 bits by duplicating each bit.
 // Ex.: 1001 -> 11000011
@@ -20,8 +21,8 @@ static unsigned char double_bits_half[16] = {
 // The video structure contains global variables for this library.
 static struct {
     unsigned int *roller;       // 0: Roller RAM address
-    unsigned int *line_starts;  // 2: Line start offsets
-    unsigned char *screen;      // 4: Screen memory address
+    unsigned int *line_starts;  // 2: Line start offsets of the drawing target
+    unsigned char *screen;      // 4: Memory of the drawing target
     unsigned char row;          // 6: Row where the next character will be
                                 //    printed
     unsigned char col;          // 7: Column where the next character will be
@@ -32,7 +33,81 @@ static struct {
     unsigned char font_size;    // 12: Size at which the next character will be
                                 //     printed
     unsigned char *brightness;  // 13: Brightness for double width character
-} video = { NULL, NULL, 0, 0, NULL, NULL, 0, NULL };
+    unsigned char *background;  // 15: Pattern drawn behind characters, NULL
+                                //     for none
+    unsigned char *pattern;     // 17: Pattern used by the fill functions
+    unsigned int stride;        // 19: Bytes from a row of cells to the next
+    unsigned char columns;      // 21: Columns of the drawing target
+    unsigned char rows;         // 22: Rows of the drawing target
+    unsigned char attributes;   // 23: Attributes of printed characters
+    unsigned int clip_left;     // 24: Viewport, in pixels, inclusive
+    unsigned char clip_top;     // 26
+    unsigned int clip_right;    // 27
+    unsigned char clip_bottom;  // 29
+    unsigned char text_left;    // 30: Cells of the viewport where text wraps
+    unsigned char text_top;     // 31
+    unsigned char text_right;   // 32: First column after the viewport
+    unsigned char text_bottom;  // 33: First row after the viewport
+} video = {
+    NULL, NULL, 0, 0, NULL, NULL, 0, NULL, NULL, NULL, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0
+};
+
+#ifdef VIDEO_STATS
+// Counters of the instrumented build, see video_stats()
+static struct video_counter stats[STAT_COUNT];
+
+static const char *stat_names[STAT_COUNT] = {
+    "print normal", "print double width", "print double height",
+    "print double", "vertical_line", "horizontal_line", "line",
+    "fill_rect", "clear_screen", "init_video_ram"
+};
+
+// Screen bytes written per character for each size
+static unsigned char print_bytes[4] = { 8, 16, 16, 32 };
+
+static void stat_draw(unsigned char counter, unsigned long units, unsigned long bytes) {
+    stats[counter].units += units;
+    stats[counter].bytes += bytes;
+}
+
+#define STAT_CALL(counter) stats[counter].calls++
+#define STAT_DRAW(counter, units, bytes) stat_draw(counter, units, bytes)
+#else
+// Without VIDEO_STATS the instrumentation is compiled out entirely
+#define STAT_CALL(counter)
+#define STAT_DRAW(counter, units, bytes)
+#endif
+
+// The screen, as a canvas. The video structure describes the canvas being
+// drawn to, which is the screen unless set_target() chose another one.
+static struct canvas screen_canvas;
+
+// The canvas chosen by set_target()
+static struct canvas *target = &screen_canvas;
+
+// Grey levels as 8x8 ordered dither patterns (4x4 Bayer matrix repeated).
+// Level n lights n pixels out of 16. Each pattern holds one byte per line of a
+// character cell, the line being selected by y & 7.
+static unsigned char grey_patterns[GREY_LEVELS * 8] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x88, 0x00, 0x00, 0x00, 0x88, 0x00, 0x00, 0x00,
+    0x88, 0x00, 0x22, 0x00, 0x88, 0x00, 0x22, 0x00,
+    0xaa, 0x00, 0x22, 0x00, 0xaa, 0x00, 0x22, 0x00,
+    0xaa, 0x00, 0xaa, 0x00, 0xaa, 0x00, 0xaa, 0x00,
+    0xaa, 0x44, 0xaa, 0x00, 0xaa, 0x44, 0xaa, 0x00,
+    0xaa, 0x44, 0xaa, 0x11, 0xaa, 0x44, 0xaa, 0x11,
+    0xaa, 0x55, 0xaa, 0x11, 0xaa, 0x55, 0xaa, 0x11,
+    0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55,
+    0xee, 0x55, 0xaa, 0x55, 0xee, 0x55, 0xaa, 0x55,
+    0xee, 0x55, 0xbb, 0x55, 0xee, 0x55, 0xbb, 0x55,
+    0xff, 0x55, 0xbb, 0x55, 0xff, 0x55, 0xbb, 0x55,
+    0xff, 0x55, 0xff, 0x55, 0xff, 0x55, 0xff, 0x55,
+    0xff, 0xdd, 0xff, 0x55, 0xff, 0xdd, 0xff, 0x55,
+    0xff, 0xdd, 0xff, 0x77, 0xff, 0xdd, 0xff, 0x77,
+    0xff, 0xff, 0xff, 0x77, 0xff, 0xff, 0xff, 0x77,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
 
 // Function type for a print function
 typedef void PRINT_FUNCTION(const char *string);
@@ -51,6 +126,16 @@ PRINT_FUNCTION *prints[] = {
     print_double_size
 };
 
+// Set while print_utf8() prints: the print functions then decode the string
+// as UTF-8 and map its characters to glyphs as they draw them.
+static unsigned char utf8_mode = 0;
+
+static unsigned char utf8_char(const unsigned char **string);
+
+// Character at string for the print functions, string being left on the
+// last byte of the character in UTF-8 mode.
+#define PRINT_CHAR(string) (utf8_mode ? utf8_char(&string) : *string)
+
 // Set the character size.
 // The available values are SIZE_NORMAL, SIZE_DOUBLE_WIDTH, SIZE_DOUBLE_HEIGHT,
 // and SIZE_DOUBLE.
@@ -68,53 +153,210 @@ void set_brightness(unsigned char brightness) {
     }
 }
 
+// Returns the pattern of a grey level.
+// level=[0..GREY_LEVELS-1], 0 being black and GREY_LEVELS-1 full green.
+unsigned char *grey_pattern(unsigned char level) {
+    return &grey_patterns[level * 8];
+}
+
+// Set the pattern used by fill_rect() and pattern_span(). A pattern is 8 bytes,
+// one for each line of a character cell, which may come from grey_pattern() or
+// from the user.
+void set_pattern(unsigned char *pattern) {
+    video.pattern = pattern;
+}
+
+// Set the pattern drawn behind printed characters. NULL disables it.
+void set_background(unsigned char *pattern) {
+    video.background = pattern;
+}
+
+// Set the attributes of printed characters, a combination of ATTR_INVERSE,
+// ATTR_UNDERLINE, ATTR_BOLD and ATTR_ITALIC, or ATTR_NONE.
+void set_attributes(unsigned char attributes) {
+    video.attributes = attributes;
+}
+
+// Returns the attributes of printed characters.
+unsigned char get_attributes() {
+    return video.attributes;
+}
+
+// Limit drawing to the rectangle x1, y1 to x2, y2 (inclusive) of the drawing
+// target. Lines, plots, fills and scrolls are clipped to it, and text wraps
+// within its whole cells. Coordinates beyond the target are brought back to
+// its edges.
+void set_viewport(unsigned int x1, unsigned char y1, unsigned int x2, unsigned char y2) {
+    unsigned int width;
+
+    width = video.columns * 8;
+    if(x2 >= width) x2 = width - 1;
+    if(y2 >= video.rows * 8) y2 = video.rows * 8 - 1;
+
+    video.clip_left = x1;
+    video.clip_top = y1;
+    video.clip_right = x2;
+    video.clip_bottom = y2;
+
+    video.text_left = (x1 + 7) >> 3;
+    video.text_top = (y1 + 7) >> 3;
+    video.text_right = (x2 + 1) >> 3;
+    video.text_bottom = (y2 + 1) >> 3;
+}
+
+// Trim a rectangle to the viewport.
+// Returns 0 if nothing is left of it, 1 otherwise.
+static unsigned char clip_rect(
+    unsigned int *x1,
+    unsigned char *y1,
+    unsigned int *x2,
+    unsigned char *y2
+) {
+    if(*x1 < video.clip_left) *x1 = video.clip_left;
+    if(*y1 < video.clip_top) *y1 = video.clip_top;
+    if(*x2 > video.clip_right) *x2 = video.clip_right;
+    if(*y2 > video.clip_bottom) *y2 = video.clip_bottom;
+
+    return *x1 <= *x2 && *y1 <= *y2;
+}
+
 // Allocate memory for screen and roller RAM.
 // The stack is placed by the C runtime at the top of free memory. The screen
-// memory is placed right under the stack. The stack_size parameter sets the
-// size of the stack to keep available.
+// memory is placed right under the stack, but below 0xC000. The stack_size
+// parameter sets the size of the stack to keep available.
+// The memory between the end of the program and the roller RAM is given to
+// the arena allocator for other buffers.
 void alloc_screen_memory(unsigned int stack_size) {
     // Trick to get the stack address.
     void *p = NULL;
+    unsigned int top;
+    unsigned char *base;
+
+    top = (unsigned int)&p - stack_size;
+
+    // CP/M Plus maps the TPA blocks 4 to 6 at 0x0000-0xBFFF and the common
+    // block 3 at 0xC000-0xFFFF. roller_entry() and set_roller_ram_address()
+    // take BASE_BANK plus the top 2 bits of an address as its block, which
+    // is only true under 0xC000: the roller RAM and the screen are kept
+    // below, whatever room the stack leaves in the common block.
+    if(top > 0xC000) top = 0xC000;
 
     // The roller RAM address must be a multiple of 512.
-    video.roller = (&p - stack_size - SCREEN_SIZE - ROLLER_SIZE * 2) & 0xFE00;
-    video.line_starts = (&p - stack_size - SCREEN_SIZE - ROLLER_SIZE) & 0xFE00;
+    base = (unsigned char *)((top - SCREEN_SIZE - ROLLER_SIZE * 2) & 0xFE00);
+    video.roller = (unsigned int *)base;
+    screen_canvas.line_starts = (unsigned int *)(base + ROLLER_SIZE);
 
-    // Video memory directly follows the roller RAM.
-    video.screen = video.roller + ROLLER_ENTRIES * 2;
+    // Video memory directly follows the roller RAM and line starts.
+    screen_canvas.buffer = base + ROLLER_SIZE * 2;
+    screen_canvas.columns = SCREEN_WIDTH / 8;
+    screen_canvas.rows = SCREEN_HEIGHT / 8;
+    screen_canvas.stride = SCREEN_WIDTH;
+
+    arena_init(program_end(), base);
 }
 
-// Initialize the roller RAM to point at our own screen memory
-void init_roller_ram() {
+// Returns the roller RAM entry of a screen line: the RAM bank holding the line
+// in the upper 3 bits, then the address of the line in the bank divided by 2
+// with the line in the character cell kept in the lower 3 bits. The address
+// must be below 0xC000 (see alloc_screen_memory()).
+static unsigned int roller_entry(unsigned int address) {
+    unsigned int inbank;
+
+    inbank = address & (BANK_SIZE - 1);
+    return (((address >> 14) + BASE_BANK) << 13)
+         + ((inbank >> 1) & 0xFFF8)
+         + (inbank & 7);
+}
+
+// Fill the line start table of a buffer of rows of cells: the 8 lines of a
+// row of cells are interleaved, one byte apart.
+static void init_line_starts(unsigned int *line_starts, unsigned char *buffer, unsigned char rows, unsigned int stride) {
     unsigned char line;
     unsigned char row;
-    unsigned int index;
     unsigned int address;
-    unsigned int inbank;
 
-    // The roller RAM has one entry for each screen line
-    index = 0;
-    address = (unsigned int)video.screen;
-
-    // There are 32 rows on a PCW screen
-    for(row = 0; row < 32; row++) {
+    address = (unsigned int)buffer;
+    for(row = 0; row < rows; row++) {
         // Each row groups 8 screen lines
         for(line = 0; line < 8; line++) {
-            // Determines which RAM bank will hold the line
-            inbank = address & (BANK_SIZE - 1);
+            *line_starts++ = address++;
+        }
+
+        address += stride - 8;
+    }
+}
+
+// The roller RAM tells the video hardware which line of memory to display on
+// each of the 256 screen lines. The following functions change what is
+// displayed only by rewriting roller entries: no pixel is copied, drawing
+// still goes to the lines of the screen memory, and the effects are undone by
+// roller_reset().
+
+// Display every screen line from its own memory line again.
+void roller_reset() {
+    unsigned int y;
+
+    for(y = 0; y < ROLLER_ENTRIES; y++) {
+        video.roller[y] = roller_entry(screen_canvas.line_starts[y]);
+    }
+}
 
-            video.line_starts[index] = address;
-            video.roller[index++] = (((address >> 14) + BASE_BANK) << 13)
-                                  + ((inbank >> 1) & 0xFFF8)
-                                  + (inbank & 7);
+// Display the memory of line source on screen line y.
+void roller_map(unsigned char y, unsigned char source) {
+    video.roller[y] = roller_entry(screen_canvas.line_starts[source]);
+}
 
-            address++;
+// Display lines y1 to y2 from the lines starting at source, each source line
+// being repeated factor times (2 or 4 for a 2x or 4x vertical zoom).
+void roller_zoom(unsigned char y1, unsigned char y2, unsigned char source, unsigned char factor) {
+    unsigned int y;
+    unsigned int entry;
+    unsigned char count;
+
+    entry = roller_entry(screen_canvas.line_starts[source]);
+    count = factor;
+    for(y = y1; y <= y2; y++) {
+        video.roller[y] = entry;
+        if(--count == 0) {
+            entry = roller_entry(screen_canvas.line_starts[++source]);
+            count = factor;
         }
+    }
+}
+
+// Display lines y1 to y2 from the lines going up from source. With source
+// equal to y2 the band is flipped upside down, with source equal to y1 - 1
+// the band reflects the lines above it.
+void roller_mirror(unsigned char y1, unsigned char y2, unsigned char source) {
+    unsigned int y;
+
+    for(y = y1; y <= y2; y++) {
+        video.roller[y] = roller_entry(screen_canvas.line_starts[source--]);
+    }
+}
+
+// Display line source on every line from y1 to y2.
+void roller_repeat(unsigned char y1, unsigned char y2, unsigned char source) {
+    unsigned int y;
+    unsigned int entry;
 
-        address += 720-8;
+    entry = roller_entry(screen_canvas.line_starts[source]);
+    for(y = y1; y <= y2; y++) {
+        video.roller[y] = entry;
     }
 }
 
+// Initialize the roller RAM to point at our own screen memory
+void init_roller_ram() {
+    init_line_starts(
+        screen_canvas.line_starts,
+        screen_canvas.buffer,
+        screen_canvas.rows,
+        screen_canvas.stride
+    );
+    roller_reset();
+}
+
 // Sets the roller RAM address
 void set_roller_ram_address() {
     unsigned int bank;
@@ -134,20 +376,61 @@ void restore_video_ram() {
     outp(SET_ROLLER_ADDRESS, 0x5B);
 }
 
-// Clear the screen
+// Returns the address of the screen memory. Its layout is the one set by
+// init_roller_ram(): 32 rows of 90 cells of 8 bytes.
+unsigned char *get_screen() {
+    return screen_canvas.buffer;
+}
+
+// Returns the address of a cell of the drawing target, whose 8 lines follow
+// each other. The cells of a row are contiguous, left to right.
+unsigned char *cell_address(unsigned char col, unsigned char row) {
+    return (unsigned char *)(video.line_starts[row << 3]) + col * 8;
+}
+
+// Clear the screen, or the canvas chosen by set_target()
 void clear_screen() {
-    memset(video.screen, 0, SCREEN_SIZE);
+    STAT_CALL(STAT_CLEAR);
+    STAT_DRAW(STAT_CLEAR, video.rows * video.stride * 8L, video.rows * video.stride);
+    memset(video.screen, 0, video.rows * video.stride);
 }
 
 // Sets the position of the next character to be printed.
-// col=[0..89], row=[0..31]
+// col=[0..89], row=[0..31] on the screen. Positions where a character of the
+// current size would not fit in the text viewport are brought back to its
+// edges.
 void locate(unsigned char col, unsigned char row) {
+    unsigned char width;
+    unsigned char height;
+
+    width = video.font_size & 1;
+    height = video.font_size >> 1;
+    if(col + width >= video.text_right) col = video.text_right - 1 - width;
+    if(row + height >= video.text_bottom) row = video.text_bottom - 1 - height;
+
+    // Also catches the subtractions above wrapping in a too small viewport
+    if(col < video.text_left || col > video.text_right) col = video.text_left;
+    if(row < video.text_top || row > video.text_bottom) row = video.text_top;
+
     video.row = row;
     video.col = col;
-    video.address = video.screen + row * 720 + col * 8;
+    video.address = video.screen + row * video.stride + col * 8;
+}
+
+// Move the cursor to the start of the next line of the viewport, or to its
+// top when the characters would not fit.
+void next_text_line() {
+    video.row += (video.font_size & 2) ? 2 : 1;
+    if(video.row + (video.font_size >> 1) >= video.text_bottom) {
+        video.row = video.text_top;
+    }
+
+    locate(video.text_left, video.row);
 }
 
-// Update the cursor position after each printed character.
+// Update the cursor position after each printed character. Text wraps within
+// the viewport, before a character of the current size would cross its right
+// edge.
 void advance_cursor() {
     /*
     if(video.font_size & 1) {
@@ -158,26 +441,14 @@ void advance_cursor() {
         video.address += 8;
     }
 
-    if(video.col < 90) return;
-
-    video.col = 0;
-
-    if(video.font_size & 2) {
-        video.row += 2;
-        video.address += 720;
-    } else {
-        video.row++;
-    }
-
-    if(video.row < 32) return;
+    if(video.col + (video.font_size & 1) < video.text_right) return;
 
-    video.row = 0;
-    video.address = video.screen;
+    next_text_line();
 */
 /*
     unsigned int *roller;       // 0: Roller RAM address
-    unsigned int *line_starts;  // 2: Line start offsets
-    unsigned char *screen;      // 4: Screen memory address
+    unsigned int *line_starts;  // 2: Line start offsets of the drawing target
+    unsigned char *screen;      // 4: Memory of the drawing target
     unsigned char row;          // 6: Row where the next character will be
                                 //    printed
     unsigned char col;          // 7: Column where the next character will be
@@ -222,63 +493,172 @@ void advance_cursor() {
     ld (_video+8), hl
 
 .same_line
-    ; if(video.col < 90) return;
-    ld a, (_video+7)
-    cp 90
+    ; if(video.col + (video.font_size & 1) < video.text_right) return;
+    ld a, (_video+12)
+    and 1
+    ld hl, _video+7
+    add a, (hl)
+    ld hl, _video+32
+    cp (hl)
     ret c
 
-.next_line
-    ; video.col = 0;
-    xor a
-    ld (_video+7), a
+    ; next_text_line();
+    jp _next_text_line
 
-    ; if(video.font_size & 2) {
-	ld a, (_video+12)
-	and	2
-	jp z, simple_height
+#endasm
+}
 
-.double_height
-    ; video.row += 2;
-    ld a, (_video+6)
-    add 2
-    ld (_video+6), a
+// Glyph buffer used when characters must be altered before being drawn.
+static unsigned char styled_glyph[8];
 
-    ; video.address += 720;
-    ld hl, (_video+8)
-    ld de, 720
+// Returns the drawing of a character, combined with the background pattern
+// and altered by the attributes when they are set. Each byte is altered while
+// in a register: background, bold (the byte ORed with itself shifted right),
+// italic (the upper half shifted right), then inverse. Underline sets the
+// last line, before inverse.
+unsigned char *glyph(unsigned char c) {
+/*
+    unsigned char i;
+    unsigned char byte;
+    unsigned char *drawing;
+    unsigned char *background;
+
+    drawing = &video.font[c * 8];
+    if(video.background == NULL && video.attributes == 0) return drawing;
+
+    background = video.background;
+    if(background == NULL) background = grey_patterns;
+
+    for(i = 0; i != 8; i++) {
+        byte = drawing[i] | background[i];
+        if(video.attributes & ATTR_BOLD) byte |= byte >> 1;
+        if((video.attributes & ATTR_ITALIC) && i < 4) byte >>= 1;
+        if(video.attributes & ATTR_INVERSE) byte = ~byte;
+        styled_glyph[i] = byte;
+    }
+
+    if(video.attributes & ATTR_UNDERLINE) {
+        styled_glyph[7] = video.attributes & ATTR_INVERSE ? 0 : 255;
+    }
+
+    return styled_glyph;
+*/
+#asm
+    ; c +2
+    ld hl, 2
+    add hl, sp
+    ld l, (hl)
+
+    ; hl = &video.font[c * 8]
+    ld h, 0
+    add hl, hl
+    add hl, hl
+    add hl, hl
+    ld de, (_video+10)
     add hl, de
-    ld (_video+8), hl
-	jp	same_page
 
-.simple_height
-    ; video.row++;
-	ld	hl, _video+6
-	inc	(hl)
+    ; if(video.background == NULL && video.attributes == 0) return drawing;
+    ld a, (_video+23)
+    ld c, a
+    ld de, (_video+15)
+    or d
+    or e
+    ret z
+
+    ; if(background == NULL) background = grey_patterns; (level 0 is empty)
+    ld a, d
+    or e
+    jr nz, has_background_gl
+    ld de, _grey_patterns
+
+.has_background_gl
+    ; hl = drawing, de = background, iy = styled_glyph, b = i, c = attributes
+    push iy
+    ld iy, _styled_glyph
+    ld b, 0
 
-.same_page
-    ; if(video.row < 32) return;
-	ld	a,(_video+6)
-    cp 32
-    ret c
-.next_page
-    ; video.row = 0;
-    xor a
-    ld (_video+6), a
-
-    ; video.address = video.screen;
-	ld	de, _video+8
-	ld	hl, _video+4
-    ldi
-    ldi
-	ret
+.forloop_gl
+    ; byte = drawing[i] | background[i];
+    ld a, (de)
+    or (hl)
+
+    ; if(video.attributes & ATTR_BOLD) byte |= byte >> 1;
+    bit 2, c
+    jr z, not_bold_gl
+    ld (iy+0), a
+    srl a
+    or (iy+0)
+
+.not_bold_gl
+    ; if((video.attributes & ATTR_ITALIC) && i < 4) byte >>= 1;
+    bit 3, c
+    jr z, not_italic_gl
+    bit 2, b
+    jr nz, not_italic_gl
+    srl a
+
+.not_italic_gl
+    ; if(video.attributes & ATTR_INVERSE) byte = ~byte;
+    bit 0, c
+    jr z, not_inverse_gl
+    cpl
+
+.not_inverse_gl
+    ld (iy+0), a
+    inc iy
+    inc hl
+    inc de
+    inc b
+    bit 3, b
+    jr z, forloop_gl
+
+    ; if(video.attributes & ATTR_UNDERLINE) styled_glyph[7] = 0 or 255
+    bit 1, c
+    jr z, not_underline_gl
+    ld a, c
+    and 1
+    dec a
+    ld (iy-1), a
 
+.not_underline_gl
+    pop iy
+    ld hl, _styled_glyph
+    ret
 #endasm
 }
 
 // Main print function which uses the dedicated print function given the current
-// settings.
+// settings. Characters are only drawn inside the text viewport: the cursor is
+// brought back into it first, going to the next line when a character of the
+// current size does not fit before its right edge, and nothing is printed
+// when the viewport cannot hold a character.
 void print(const unsigned char *string) {
+#ifdef VIDEO_STATS
+    unsigned int length;
+#endif
+
+    if(video.col + (video.font_size & 1) >= video.text_right) next_text_line();
+    locate(video.col, video.row);
+    if(video.text_left + (video.font_size & 1) >= video.text_right
+       || video.text_top + (video.font_size >> 1) >= video.text_bottom) {
+        return;
+    }
+
+#ifdef VIDEO_STATS
+    length = strlen(string);
+    STAT_CALL(STAT_PRINT_NORMAL + video.font_size);
+    STAT_DRAW(
+        STAT_PRINT_NORMAL + video.font_size,
+        length,
+        length * print_bytes[video.font_size]
+    );
+
+    video_sample_begin();
     prints[video.font_size](string);
+    video_sample_end();
+#else
+    prints[video.font_size](string);
+#endif
 }
 
 // Print normal size characters. This uses memcpy in order to draw characters
@@ -293,6 +673,19 @@ void print_normal_size(const unsigned char *string) {
     }*/
 
 #asm
+    ; if(video.background != NULL || video.attributes != 0)
+    ;     print_normal_styled(string)
+    ld hl, (_video+15)
+    ld a, (_video+23)
+    or h
+    or l
+    jp nz, _print_normal_styled
+
+    ; if(utf8_mode) print_normal_utf8(string)
+    ld a, (_utf8_mode)
+    or a
+    jp nz, _print_normal_utf8
+
     ; IX = stack frame
     ; string +4
     ; i -1, character_drawing -3, left -4, right -5, offset -7
@@ -342,13 +735,99 @@ void print_normal_size(const unsigned char *string) {
 
 }
 
+// Print normal size characters decoded from UTF-8, used by
+// print_normal_size() for print_utf8(). ASCII characters only cost the
+// compare with 128 and a lookup in utf8_ascii on top of its loop.
+void print_normal_utf8(const unsigned char *string) {
+/*
+    unsigned char c;
+
+    for(; *string != '\0'; string++) {
+        c = *string;
+        c = c < 0x80 ? utf8_ascii[c] : utf8_char(&string);
+        memcpy(video.address, &video.font[c * 8], 8);
+        advance_cursor();
+    }
+*/
+#asm
+    ; string +2
+    ld hl, 2
+    add hl, sp
+    ld c, (hl)
+    inc hl
+    ld b, (hl)
+
+.forloop_pnu
+    ; for(; *string != '\0'; string++) {
+    ld a, (bc)
+    or a
+    ret z
+
+    ; c = c < 0x80 ? utf8_ascii[c] : utf8_char(&string)
+    cp 0x80
+    jr nc, decode_pnu
+    ld l, a
+    ld h, 0
+    ld de, _utf8_ascii
+    add hl, de
+    ld a, (hl)
+    jr draw_pnu
+
+.decode_pnu
+    push bc
+    ld hl, 0
+    add hl, sp
+    push hl
+    call _utf8_char
+    pop de
+    pop bc
+    ld a, l
+
+.draw_pnu
+    ; &video.font[c * 8]
+    ld l, a
+    ld h, 0
+    add hl, hl
+    add hl, hl
+    add hl, hl
+    ld de, (_video+10)
+    add hl, de
+
+    push bc
+    ld de, (_video+8)
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+
+    call _advance_cursor
+    pop bc
+
+    inc bc
+    jr forloop_pnu
+#endasm
+}
+
+// Print normal size characters through glyph(), used by print_normal_size()
+// when characters must be altered.
+void print_normal_styled(const unsigned char *string) {
+    for(; *string != '\0'; string++) {
+        memcpy(video.address, glyph(PRINT_CHAR(string)), 8);
+        advance_cursor();
+    }
+}
+
 // Print double width characters.
 void print_double_width(const unsigned char *string) {
     unsigned char i;
     unsigned char *character_drawing;
 
     for(; *string != '\0'; string++) {
-        character_drawing = &video.font[*string * 8];
+        character_drawing = glyph(PRINT_CHAR(string));
         for(i = 0; i != 8; i++) {
             // Left part
             video.address[i] = video.brightness[*character_drawing >> 4];
@@ -364,7 +843,8 @@ void print_double_width(const unsigned char *string) {
 
 
 // Look up table to accelerate character drawing when using double height.
-const unsigned int dh_offset[] = {
+// The second half is offset by the stride of the drawing target.
+unsigned int dh_offset[] = {
     0, 1, 2, 3, 4, 5, 6, 7, 720, 721, 722, 723, 724, 725, 726, 727
 };
 
@@ -374,7 +854,7 @@ void print_double_height(const unsigned char *string) {
     unsigned char *character_drawing;
 
     for(; *string != '\0'; string++) {
-        character_drawing = &video.font[*string * 8];
+        character_drawing = glyph(PRINT_CHAR(string));
         for(i = 0; i != 16; i+= 2) {
             // The same line is printed twice
             video.address[dh_offset[i]] = *character_drawing;
@@ -397,7 +877,7 @@ void print_double_size(const unsigned char *string) {
     unsigned int offset;
 
     for(; *string != '\0'; string++) {
-        character_drawing = &video.font[*string * 8];
+        character_drawing = glyph(PRINT_CHAR(string));
         for(i = 0; i != 16; i+= 2) {
             left = video.brightness[*character_drawing >> 4];
             right = video.brightness[*character_drawing & 15];
@@ -443,21 +923,32 @@ void print_double_size(const unsigned char *string) {
     or a
     jp z, endloop_pds
 
+    ; if(utf8_mode) a = utf8_char(&string), string being left on the last
+    ; byte of the character
+    ld a, (_utf8_mode)
+    or a
+    ld a, (hl)
+    jr z, glyph_pds
+    push hl
+    ld hl, 0
+    add hl, sp
+    push hl
+    call _utf8_char
+    pop de
+    ld a, l
+    pop hl
+
+.glyph_pds
     inc hl
     push hl
 
-    ; *string * 8
+    ; character_drawing = glyph(PRINT_CHAR(string));
     ld l, a
     ld h, 0
-    add hl, hl
-    add hl, hl
-    add hl, hl
-
-    ; character_drawing = &video.font[*string * 8];
-    ex de, hl
-    ld hl, (_video+10)
-    add hl, de
-    ex de, hl ; de = &video.font[*string * 8]
+    push hl
+    call _glyph
+    pop bc
+    ex de, hl ; de = glyph(PRINT_CHAR(string))
 
     ld a, 0
     ; for(i = 0; i != 16; i+= 2) {
@@ -540,125 +1031,707 @@ void print_double_size(const unsigned char *string) {
 #endasm
 }
 
-// Defines which font to use when printing characters on the screen.
-void set_font(unsigned char *font) {
-    video.font = font;
+// Characters gathered by print_run() for print_line() to be printed as one
+// string by print(), the paragraph text not being NUL terminated at line ends.
+#define RUN_LENGTH 32
+static unsigned char run[RUN_LENGTH + 1];
+static unsigned char run_length = 0;
+
+// Print the characters gathered by print_run().
+static void print_flush() {
+    if(run_length == 0) return;
+    run[run_length] = '\0';
+    run_length = 0;
+    print(run);
 }
 
-unsigned char vertical_masks[] = { 128, 64, 32, 16, 8, 4, 2, 1 };
-void vertical_line(unsigned int x, unsigned char y1, unsigned char y2) {
-/*    unsigned char mask;
-    unsigned char y;
-    unsigned int offset;
-    unsigned char *address;
-    unsigned int *line_start;
+// Add a character to the ones to print, printing them when RUN_LENGTH are
+// gathered.
+static void print_run(unsigned char c) {
+    run[run_length++] = c;
+    if(run_length == RUN_LENGTH) print_flush();
+}
 
-    mask = vertical_masks[(unsigned char)x & 7];
-    offset = x & 0xfff8;
+// Print the characters from string to end through print_run(). Each gap
+// between words is printed as spaces spaces, plus one for the last extra gaps
+// of the line.
+static void print_line(
+    const unsigned char *string,
+    const unsigned char *end,
+    unsigned char spaces,
+    unsigned char gaps,
+    unsigned char extra
+) {
+    unsigned char i;
 
-    line_start = &video.line_starts[y1];
-    for(y = y1; y != y2 + 1; y++) {
-        address = (unsigned char *)(*line_start) + offset;
-        *address |= mask;
-        line_start++;
-    }
-*/
-#asm
-    ; x +8, y1 +6, y2 +4
-    ; mask -1, y -2, offset -4, line_start -6
-    ; IX = stack frame
-    push ix
-    ld ix, 0
-    add ix, sp
+    while(string != end) {
+        if(*string != ' ') {
+            print_run(*string++);
+            continue;
+        }
 
-    ; Reserve 6 bytes on the stack
-    push bc
-    push bc
-    push bc
+        // A gap between words, whatever its number of spaces
+        while(*string == ' ') string++;
+        i = spaces + (gaps-- <= extra);
 
-    ; mask = vertical_masks[(unsigned char)x & 7];
-    ld a, (ix+8) ; x
-    and 7
-    ld e, a
-    ld d, 0
-    ld hl, _vertical_masks
-    add hl,de
-    ld a,(hl)
+        for(; i != 0; i--) print_run(' ');
+    }
 
-    ld (ix-1), a ; mask
+    print_flush();
+}
 
-    ; offset = x & 0xfff8;
-    ld a, (ix+8) ; x
-    and 0xf8
-    ld e, a
-    ld d, (ix+9)
+// Lay out a paragraph in width cells from col, row, wrapping lines between
+// words (words longer than a line are cut) and starting a new line at each
+// '\n'. With PARAGRAPH_JUSTIFY, the spaces of every line but the last of
+// the paragraph are widened so the line fills the width, the extra spaces
+// going to the rightmost gaps. Lines are measured then printed as the text
+// is read, without copying them. Returns the row following the paragraph.
+unsigned char print_paragraph(
+    const unsigned char *text,
+    unsigned char col,
+    unsigned char row,
+    unsigned char width,
+    unsigned char flags
+) {
+    unsigned char capacity;
+    unsigned char length;
+    unsigned char words;
+    unsigned char word;
+    unsigned char gaps;
+    const unsigned char *start;
+    const unsigned char *end;
+    const unsigned char *next;
+
+    capacity = (video.font_size & 1) ? width >> 1 : width;
+    if(capacity == 0) return row;
+
+    while(*text != '\0') {
+        // Spaces at the start of a line are not printed
+        while(*text == ' ') text++;
+        start = text;
+        end = text;
+        length = 0;
+        words = 0;
+
+        // Take as many words as the line can hold
+        while(*text != '\0' && *text != '\n') {
+            for(next = text; *next != '\0' && *next != ' ' && *next != '\n'; next++);
+            word = next - text;
+
+            if(length + (words != 0) + word > capacity) {
+                if(words == 0) {
+                    end = text + capacity;
+                    length = capacity;
+                    words = 1;
+                }
+                break;
+            }
+
+            length += (words != 0) + word;
+            words++;
+            end = next;
+
+            for(text = next; *text == ' '; text++);
+        }
 
-    ld (ix-4), e ; offset
-    ld (ix-3), d
+        // The last line of a paragraph is not justified
+        gaps = words - 1;
+        if((flags & PARAGRAPH_JUSTIFY) && words > 1
+           && *text != '\0' && *text != '\n') {
+            locate(col, row);
+            print_line(
+                start, end,
+                1 + (capacity - length) / gaps,
+                gaps,
+                (capacity - length) % gaps
+            );
+        } else {
+            locate(col, row);
+            print_line(start, end, 1, gaps, 0);
+        }
 
-    ; line_start = &video.line_starts[y1];
-    ld e, (ix+6) ; y1
-    ld d, 0
+        text = end;
+        while(*text == ' ') text++;
+        if(*text == '\n') text++;
 
-    ld    hl, (_video+1+1)
-    add hl, de
-    add hl, de
+        row += (video.font_size & 2) ? 2 : 1;
+    }
 
-    ex (sp), hl
+    return row;
+}
 
-    ; for(y = y1; y != y2 + 1; y++) {
-    ld a, (ix+4) ; y2
-    sub a, (ix+6) ; y1
+// Glyph printed for characters which are not in the font
+#define UTF8_REPLACEMENT '?'
+
+// Glyphs of the ASCII characters. The PCW font replaces @[\]{|}~ with
+// accented letters and symbols, their own glyphs being above 127.
+static unsigned char utf8_ascii[128] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+    0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
+    0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+    0xea, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,
+    0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,
+    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57,
+    0x58, 0x59, 0x5a, 0xa2, 0xf5, 0xa6, 0x5e, 0x5f,
+    0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+    0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
+    0x78, 0x79, 0x7a, 0xe1, 0xee, 0xeb, 0xb2, 0x7f
+};
 
-    or a
-    jp z, endfor
+// Number of code points above 127 the font can display
+#define UTF8_GLYPHS 100
+
+// Code points above 127 the font can display, in increasing order, and their
+// glyphs.
+static unsigned int utf8_codes[UTF8_GLYPHS] = {
+    0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x00a5, 0x00a7, 0x00a8, 0x00a9,
+    0x00aa, 0x00ab, 0x00ae, 0x00b0, 0x00b1, 0x00b4, 0x00b5, 0x00b6,
+    0x00ba, 0x00bb, 0x00bc, 0x00bd, 0x00be, 0x00bf, 0x00c0, 0x00c1,
+    0x00c2, 0x00c3, 0x00c4, 0x00c5, 0x00c6, 0x00c7, 0x00c8, 0x00c9,
+    0x00ca, 0x00cb, 0x00cc, 0x00cd, 0x00ce, 0x00cf, 0x00d1, 0x00d2,
+    0x00d3, 0x00d4, 0x00d5, 0x00d6, 0x00d8, 0x00d9, 0x00da, 0x00db,
+    0x00dc, 0x00df, 0x00e0, 0x00e1, 0x00e2, 0x00e3, 0x00e4, 0x00e5,
+    0x00e6, 0x00e7, 0x00e8, 0x00e9, 0x00ea, 0x00eb, 0x00ec, 0x00ed,
+    0x00ee, 0x00ef, 0x00f1, 0x00f2, 0x00f3, 0x00f4, 0x00f5, 0x00f6,
+    0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x00ff, 0x0178, 0x0192,
+    0x03b1, 0x03b2, 0x03b5, 0x03b8, 0x03bb, 0x03bc, 0x03c0, 0x03c1,
+    0x03c3, 0x03c4, 0x03c9, 0x2020, 0x2030, 0x2122, 0x2190, 0x2192,
+    0x2260, 0x2261, 0x2264, 0x2265
+};
 
-    pop de
-    push de
+static unsigned char utf8_glyphs[UTF8_GLYPHS] = {
+     32, 175, 177, 163, 189,  93, 126, 164, 160, 171,
+    190,  91,  13, 179,  23, 165, 161, 172, 168, 169,
+    170, 174, 202, 192, 197, 218, 208, 215, 214, 213,
+    203, 193, 198, 209, 204, 194, 199, 210, 217, 205,
+    195, 200, 219, 211, 216, 206, 196, 201, 212, 186,
+     64, 224, 229, 250, 240, 247, 246,  92, 125, 123,
+    230, 241, 236, 226, 231, 242, 249, 237, 227, 232,
+    251, 243, 248, 124, 228, 233, 244, 239, 207, 176,
+     16,  17,  20,  21,  22,  23,  24,  25,  26,  27,
+     31, 167, 181, 191, 253, 252, 222, 255, 221, 220
+};
 
-.forloop
-    ld l, e
-    ld h, d
+// Find the glyph of a code point above 127 by a binary search in utf8_codes.
+static unsigned char utf8_glyph(unsigned int code) {
+    unsigned char low;
+    unsigned char high;
+    unsigned char middle;
+
+    low = 0;
+    high = UTF8_GLYPHS;
+    while(low != high) {
+        middle = (low + high) >> 1;
+        if(utf8_codes[middle] == code) return utf8_glyphs[middle];
+        if(utf8_codes[middle] < code) low = middle + 1;
+        else high = middle;
+    }
 
-    ; address = (unsigned char *)(*line_start) + offset;
-    ld c,(hl)
-    inc hl
-    ld b,(hl) ; bc = *line_start
+    return UTF8_REPLACEMENT;
+}
 
-    ld l, (ix-4) ; hl=offset
-    ld h, (ix-3)
+// Decode the character at *string for the print functions in UTF-8 mode,
+// leaving *string on its last byte. Returns its glyph in the PCW font, or
+// UTF8_REPLACEMENT for characters missing from the font and malformed
+// sequences.
+static unsigned char utf8_char(const unsigned char **string) {
+    const unsigned char *next;
+    unsigned int code;
+    unsigned char c;
+    unsigned char following;
+
+    next = *string;
+    c = *next;
+    if(c < 0x80) return utf8_ascii[c];
+
+    // Lead byte: the number of continuation bytes and the first bits
+    if(c >= 0xf0) {
+        code = c & 0x07;
+        following = 3;
+    } else if(c >= 0xe0) {
+        code = c & 0x0f;
+        following = 2;
+    } else if(c >= 0xc0) {
+        code = c & 0x1f;
+        following = 1;
+    } else {
+        following = 0;
+    }
 
-    add hl, bc ; hl = *line_start + offset
+    for(; following != 0; following--) {
+        if((next[1] & 0xc0) != 0x80) break;
+        // Code points beyond 16 bits are not in the font anyway
+        code = (code << 6) | (*++next & 0x3f);
+    }
+    *string = next;
 
-    ; *address |= mask;
-    ld c, (ix-1) ; mask
+    // A stray continuation byte or a cut sequence
+    if(c < 0xc0 || following != 0 || c >= 0xf0) return UTF8_REPLACEMENT;
 
-    ld b, a
-    ld a, (hl)
-    or c
-    ld (hl), a
-    ld a, b
+    return utf8_glyph(code);
+}
 
-    ; line_start++;
-    inc de
-    inc de
+// Print an UTF-8 string, mapping its characters to the glyphs of the PCW
+// font as they are drawn: print() runs in UTF-8 mode, where the print
+// functions take their characters from utf8_char() instead of the string.
+// Normal size ASCII characters only cost the compare with 128 and a lookup
+// in utf8_ascii.
+void print_utf8(const unsigned char *string) {
+    utf8_mode = 1;
+    print(string);
+    utf8_mode = 0;
+}
 
-    dec a
-    jp nz, forloop
+// Defines which font to use when printing characters on the screen.
+void set_font(unsigned char *font) {
+    video.font = font;
+}
 
-.endfor
+unsigned char vertical_masks[] = { 128, 64, 32, 16, 8, 4, 2, 1 };
 
-    pop bc
-    pop bc
-    pop bc
-    pop ix
+// Draw the pixels of a vertical line, y1 to y2 included. The 8 lines of a
+// cell are consecutive bytes, so the address is walked directly: +1 from a
+// line to the next in a cell, + stride - 7 from a cell to the one below. The
+// line is drawn as a head (the end of the first cell), whole cells unrolled 8
+// lines at a time, and a tail.
+static void vertical_span(unsigned int x, unsigned char y1, unsigned char y2) {
+/*
+    unsigned char mask;
+    unsigned char lines;
+    unsigned char run;
+    unsigned char *address;
+
+    mask = vertical_masks[(unsigned char)x & 7];
+    address = (unsigned char *)(video.line_starts[y1]) + (x & 0xfff8);
+    lines = y2 - y1;    // lines - 1, as 256 lines do not fit a byte
+
+    run = 8 - (y1 & 7);
+    if(lines < run) run = lines + 1;
+    lines = lines + 1 - run;
+    for(;;) {
+        for(; run != 0; run--) *address++ |= mask;
+        if(lines == 0) return;
+
+        address += video.stride - 8;
+        run = lines < 8 ? lines : 8;
+        lines -= run;
+    }
+*/
+#asm
+    ; x +6, y1 +4, y2 +2
+    ld hl, 2
+    add hl, sp
+    ld a, (hl) ; y2
+    inc hl
+    inc hl
+    ld e, (hl) ; y1
+    sub e
+    ld d, a ; d = lines - 1
+    push de
+    inc hl
+    inc hl
+    ld c, (hl) ; x
+    inc hl
+    ld b, (hl)
+
+    ; hl = address of the first pixel, c = mask
+    call _pixel_address
+    ld c, a
+    pop de
+
+    ; b = 8 - (y1 & 7), lines to the end of the first cell
+    ld a, e
+    and 7
+    ld b, a
+    ld a, 8
+    sub b
+    ld b, a
+
+    ; if the line ends in the first cell, draw it and return
+    ld a, d
+    cp b
+    jr nc, head_vl
+    inc a
+    ld b, a
+
+.run_vl
+    ld a, (hl)
+    or c
+    ld (hl), a
+    inc hl
+    djnz run_vl
+    ret
+
+.head_vl
+    ; a = lines left after the head
+    sub b
+    inc a
+    push af
+
+.head_loop_vl
+    ld a, (hl)
+    or c
+    ld (hl), a
+    inc hl
+    djnz head_loop_vl
+
+    ; de = video.stride - 8, from the end of a cell to the cell below
+    ld de, (_video+19)
+    ld a, e
+    sub 8
+    ld e, a
+    jr nc, ASMPC+3
+    dec d
+
+    pop af
+    ld b, a
+
+.cells_vl
+    add hl, de
+
+    ; fewer than 8 lines left: draw the tail
+    ld a, b
+    cp 8
+    jr c, run_vl
+
+    ld a, (hl)
+    or c
+    ld (hl), a
+    inc hl
+    ld a, (hl)
+    or c
+    ld (hl), a
+    inc hl
+    ld a, (hl)
+    or c
+    ld (hl), a
+    inc hl
+    ld a, (hl)
+    or c
+    ld (hl), a
+    inc hl
+    ld a, (hl)
+    or c
+    ld (hl), a
+    inc hl
+    ld a, (hl)
+    or c
+    ld (hl), a
+    inc hl
+    ld a, (hl)
+    or c
+    ld (hl), a
+    inc hl
+    ld a, (hl)
+    or c
+    ld (hl), a
+    inc hl
+
+    ld a, b
+    sub 8
+    ld b, a
+    jr nz, cells_vl
+    ret
+#endasm
+}
+
+// Draw a vertical line, clipped to the viewport.
+void vertical_line(unsigned int x, unsigned char y1, unsigned char y2) {
+    STAT_CALL(STAT_VERTICAL_LINE);
+    if(x < video.clip_left || x > video.clip_right) return;
+    if(y1 < video.clip_top) y1 = video.clip_top;
+    if(y2 > video.clip_bottom) y2 = video.clip_bottom;
+    if(y1 > y2) return;
+
+    STAT_DRAW(STAT_VERTICAL_LINE, y2 - y1 + 1, y2 - y1 + 1);
+
+    vertical_span(x, y1, y2);
+}
+
+// Computes the address and the mask of a pixel, for use by assembly code.
+// Input: bc = x, e = y. Output: hl = screen address, a = mask. Destroys de.
+void pixel_address() {
+#asm
+    ; hl = video.line_starts[y]
+    ld hl, (_video+2)
+    ld d, 0
+    add hl, de
+    add hl, de
+    ld a, (hl)
+    inc hl
+    ld h, (hl)
+    ld l, a
+
+    ; hl += x & 0xfff8
+    ld a, c
+    and 0xf8
+    ld e, a
+    ld d, b
+    add hl, de
+
+    ; a = vertical_masks[x & 7]
+    push hl
+    ld a, c
+    and 7
+    ld e, a
+    ld d, 0
+    ld hl, _vertical_masks
+    add hl, de
+    ld a, (hl)
+    pop hl
+    ret
+#endasm
+}
+
+// Tells whether a pixel is outside of the viewport, for use by assembly code.
+// Input: bc = x, e = y. Output: carry set when outside. Destroys a, hl.
+void clip_pixel() {
+#asm
+    ; y < video.clip_top
+    ld a, e
+    ld hl, _video+26
+    cp (hl)
+    ret c
+
+    ; video.clip_bottom < y
+    ld a, (_video+29)
+    cp e
+    ret c
+
+    ; x < video.clip_left
+    ld hl, (_video+24)
+    ld a, c
+    sub l
+    ld a, b
+    sbc a, h
+    ret c
+
+    ; video.clip_right < x
+    ld hl, (_video+27)
+    ld a, l
+    sub c
+    ld a, h
+    sbc a, b
+    ret
+#endasm
+}
+
+// Set a pixel.
+void plot(unsigned int x, unsigned char y) {
+#asm
+    ; x +4, y +2
+    ld hl, 2
+    add hl, sp
+    ld e, (hl) ; y
+    inc hl
+    inc hl
+    ld c, (hl) ; x
+    inc hl
+    ld b, (hl)
+
+    call _clip_pixel
+    ret c
+
+    ; *address |= mask
+    call _pixel_address
+    or (hl)
+    ld (hl), a
+    ret
+#endasm
+}
+
+// Reset a pixel.
+void unplot(unsigned int x, unsigned char y) {
+#asm
+    ; x +4, y +2
+    ld hl, 2
+    add hl, sp
+    ld e, (hl) ; y
+    inc hl
+    inc hl
+    ld c, (hl) ; x
+    inc hl
+    ld b, (hl)
+
+    call _clip_pixel
+    ret c
+
+    ; *address &= ~mask
+    call _pixel_address
+    cpl
+    and (hl)
+    ld (hl), a
+    ret
+#endasm
+}
+
+// Returns 1 if a pixel is set, 0 otherwise.
+unsigned char point(unsigned int x, unsigned char y) {
+#asm
+    ; x +4, y +2
+    ld hl, 2
+    add hl, sp
+    ld e, (hl) ; y
+    inc hl
+    inc hl
+    ld c, (hl) ; x
+    inc hl
+    ld b, (hl)
+
+    ; Pixels outside of the viewport read as reset
+    call _clip_pixel
+    ld hl, 0
+    ret c
+
+    ; return (*address & mask) != 0
+    call _pixel_address
+    and (hl)
+    ld hl, 0
+    ret z
+    inc l
+    ret
+#endasm
+}
+
+// Set n pixels whose coordinates are given by an array of points. The clip
+// rectangle and the table addresses are copied to the stack frame once, so
+// that each pixel costs only an inline viewport test and two table lookups.
+void plot_many(struct point *points, unsigned int n) {
+/*
+    for(; n != 0; n--, points++) {
+        // Points outside of the viewport are skipped
+        if(points->y < video.clip_top || points->y > video.clip_bottom
+        || points->x < video.clip_left || points->x > video.clip_right)
+            continue;
+
+        address = (unsigned char *)video.line_starts[points->y]
+                + (points->x & 0xfff8);
+        *address |= vertical_masks[(unsigned char)points->x & 7];
+    }
+*/
+#asm
+    ; points +8, n +6
+    push ix
+    push iy
+    ld ix, 0
+    add ix, sp
+
+    ; clip_left -2, clip_right -4, clip_top -6, clip_bottom -5, masks -8
+    ld hl, (_video+24)
+    push hl
+    ld hl, (_video+27)
+    push hl
+    ld a, (_video+26)
+    ld l, a
+    ld a, (_video+29)
+    ld h, a
+    push hl
+    ld hl, _vertical_masks
+    push hl
+
+    ; iy = points, bc = n, de = video.line_starts
+    ld l, (ix+8)
+    ld h, (ix+9)
+    push hl
+    pop iy
+    ld c, (ix+6)
+    ld b, (ix+7)
+    ld de, (_video+2)
+
+    ld a, b
+    or c
+    jr z, endloop_pm
+
+.forloop_pm
+    ; points->y < video.clip_top
+    ld a, (iy+2)
+    cp (ix-6)
+    jr c, next_pm
+
+    ; video.clip_bottom < points->y
+    ld a, (ix-5)
+    cp (iy+2)
+    jr c, next_pm
+
+    ; points->x < video.clip_left
+    ld a, (iy+0)
+    sub (ix-2)
+    ld a, (iy+1)
+    sbc a, (ix-1)
+    jr c, next_pm
+
+    ; video.clip_right < points->x
+    ld a, (ix-4)
+    sub (iy+0)
+    ld a, (ix-3)
+    sbc a, (iy+1)
+    jr c, next_pm
+
+    ; a = vertical_masks[points->x & 7]
+    ld a, (iy+0)
+    and 7
+    add a, (ix-8)
+    ld l, a
+    ld a, (ix-7)
+    adc a, 0
+    ld h, a
+    ld a, (hl)
+    push af
+
+    ; hl = video.line_starts[points->y]
+    ld l, (iy+2)
+    ld h, 0
+    add hl, hl
+    add hl, de
+    ld a, (hl)
+    inc hl
+    ld h, (hl)
+    ld l, a
+
+    ; hl += points->x & 0xfff8
+    ld a, (iy+0)
+    and 0xf8
+    add a, l
+    ld l, a
+    ld a, (iy+1)
+    adc a, h
+    ld h, a
+
+    ; *address |= mask
+    pop af
+    or (hl)
+    ld (hl), a
+
+.next_pm
+    ; points++
+    inc iy
+    inc iy
+    inc iy
+
+    ; n--
+    dec bc
+    ld a, b
+    or c
+    jr nz, forloop_pm
+
+.endloop_pm
+    ld sp, ix
+    pop iy
+    pop ix
     ret
 #endasm
 }
 
 unsigned char horz_start_masks[] = { 255, 127, 63, 31, 15, 7, 3, 1 };
 unsigned char horz_end_masks[] = { 128, 192, 224, 240, 248, 252, 254, 255 };
-void horizontal_line(unsigned int x1, unsigned int x2, unsigned char y) {
+// Draw the pixels of a horizontal line, x1 to x2 included.
+static void horizontal_span(unsigned int x1, unsigned int x2, unsigned char y) {
     unsigned char start_mask;
     unsigned char end_mask;
     unsigned char pixel_count;
@@ -669,7 +1742,7 @@ void horizontal_line(unsigned int x1, unsigned int x2, unsigned char y) {
     end_mask = horz_end_masks[(unsigned char)x2 & 7];
 
     address = (unsigned char *)(video.line_starts[y]) + (x1 & 0xfff8);
-    if(x1 & 0xfff8 == x2 & 0xfff8) {
+    if((x1 & 0xfff8) == (x2 & 0xfff8)) {
         *address |= start_mask & end_mask;
         return;
     }
@@ -686,21 +1759,962 @@ void horizontal_line(unsigned int x1, unsigned int x2, unsigned char y) {
     *address |= end_mask;
 }
 
+// Draw a horizontal line, clipped to the viewport.
+void horizontal_line(unsigned int x1, unsigned int x2, unsigned char y) {
+    STAT_CALL(STAT_HORIZONTAL_LINE);
+    if(y < video.clip_top || y > video.clip_bottom) return;
+    if(x1 < video.clip_left) x1 = video.clip_left;
+    if(x2 > video.clip_right) x2 = video.clip_right;
+    if(x1 > x2) return;
+
+    STAT_DRAW(STAT_HORIZONTAL_LINE, x2 - x1 + 1, (x2 >> 3) - (x1 >> 3) + 1);
+    horizontal_span(x1, x2, y);
+}
+
+// Draw the lines first to last (0..7) of a character cell with the current
+// pattern, changing only the pixels set in mask.
+static void pattern_cell(
+    unsigned char *address,
+    unsigned char first,
+    unsigned char last,
+    unsigned char mask
+) {
+    // A complete cell is a straight 8 bytes copy of the pattern
+    if(mask == 255 && first == 0 && last == 7) {
+        memcpy(address, video.pattern, 8);
+        return;
+    }
+
+    for(; first <= last; first++) {
+        address[first] = (address[first] & ~mask)
+                        | (video.pattern[first] & mask);
+    }
+}
+
+// Fill a rectangle with the current pattern. Pixels inside the rectangle are
+// replaced, so a solid fill and a grey fill cost the same.
+void fill_rect(unsigned int x1, unsigned char y1, unsigned int x2, unsigned char y2) {
+    unsigned char start_mask;
+    unsigned char end_mask;
+    unsigned char row;
+    unsigned char first;
+    unsigned char last;
+    unsigned int col;
+    unsigned int cols;
+    unsigned char *address;
+
+    STAT_CALL(STAT_FILL);
+    if(!clip_rect(&x1, &y1, &x2, &y2)) return;
+
+    STAT_DRAW(
+        STAT_FILL,
+        (unsigned long)(x2 - x1 + 1) * (y2 - y1 + 1),
+        (unsigned long)((x2 >> 3) - (x1 >> 3) + 1) * (y2 - y1 + 1)
+    );
+
+    start_mask = horz_start_masks[(unsigned char)x1 & 7];
+    end_mask = horz_end_masks[(unsigned char)x2 & 7];
+    cols = (x2 >> 3) - (x1 >> 3);
+
+    // Works one row of character cells at a time
+    for(row = y1 >> 3; row <= (y2 >> 3); row++) {
+        first = (row == (y1 >> 3)) ? y1 & 7 : 0;
+        last = (row == (y2 >> 3)) ? y2 & 7 : 7;
+        address = (unsigned char *)(video.line_starts[row << 3])
+                + (x1 & 0xfff8);
+
+        if(cols == 0) {
+            pattern_cell(address, first, last, start_mask & end_mask);
+            continue;
+        }
+
+        pattern_cell(address, first, last, start_mask);
+        for(col = 1; col != cols; col++) {
+            address += 8;
+            pattern_cell(address, first, last, 255);
+        }
+        pattern_cell(address + 8, first, last, end_mask);
+    }
+}
+
+// Draw a horizontal span with the current pattern.
+void pattern_span(unsigned int x1, unsigned int x2, unsigned char y) {
+    fill_rect(x1, y, x2, y);
+}
+
+// Copy a rectangle of character cells to another place on the screen.
+// Each row of cells is a contiguous block of width * 8 bytes, so a row is
+// copied by a single memcpy. Rows are copied bottom up when the destination
+// is lower than the source so overlapping rectangles are handled.
+void copy_rect(
+    unsigned char src_col,
+    unsigned char src_row,
+    unsigned char width,
+    unsigned char height,
+    unsigned char dst_col,
+    unsigned char dst_row
+) {
+    unsigned int size;
+    char step;
+
+    if(width == 0 || height == 0) return;
+
+    size = width * 8;
+    step = 1;
+    if(dst_row > src_row) {
+        src_row += height - 1;
+        dst_row += height - 1;
+        step = -1;
+    }
+
+    for(; height != 0; height--) {
+        if(src_row == dst_row) {
+            // Same row, source and destination may overlap
+            memmove(
+                (unsigned char *)(video.line_starts[dst_row << 3]) + dst_col * 8,
+                (unsigned char *)(video.line_starts[src_row << 3]) + src_col * 8,
+                size
+            );
+        } else {
+            memcpy(
+                (unsigned char *)(video.line_starts[dst_row << 3]) + dst_col * 8,
+                (unsigned char *)(video.line_starts[src_row << 3]) + src_col * 8,
+                size
+            );
+        }
+
+        src_row += step;
+        dst_row += step;
+    }
+}
+
+// Holds one line of pixels, left aligned, for copy_rect_pixels().
+static unsigned char line_buffer[SCREEN_WIDTH / 8 + 2];
+
+// Read width pixels starting at (x, y) into line_buffer.
+static void read_pixels(unsigned int x, unsigned char y, unsigned int width) {
+    unsigned char shift;
+    unsigned char bytes;
+    unsigned char i;
+    unsigned char *address;
+
+    shift = (unsigned char)x & 7;
+    bytes = (width + 7) >> 3;
+    address = (unsigned char *)(video.line_starts[y]) + (x & 0xfff8);
+
+    for(i = 0; i != bytes; i++) {
+        if(shift == 0) {
+            line_buffer[i] = *address;
+        } else {
+            line_buffer[i] = (*address << shift) | (address[8] >> (8 - shift));
+        }
+        address += 8;
+    }
+
+    line_buffer[bytes] = 0;
+}
+
+// Write width pixels from line_buffer at (x, y).
+static void write_pixels(unsigned int x, unsigned char y, unsigned int width) {
+    unsigned char shift;
+    unsigned char count;
+    unsigned char end_mask;
+    unsigned char mask;
+    unsigned char data;
+    unsigned char previous;
+    unsigned char i;
+    unsigned char *address;
+
+    shift = (unsigned char)x & 7;
+    count = ((x + width - 1) >> 3) - (x >> 3);
+    end_mask = horz_end_masks[(unsigned char)(x + width - 1) & 7];
+    address = (unsigned char *)(video.line_starts[y]) + (x & 0xfff8);
+
+    mask = horz_start_masks[shift];
+    previous = 0;
+    for(i = 0; i <= count; i++) {
+        data = (previous << (8 - shift)) | (line_buffer[i] >> shift);
+        previous = line_buffer[i];
+
+        if(i == count) mask &= end_mask;
+        *address = (*address & ~mask) | (data & mask);
+
+        mask = 255;
+        address += 8;
+    }
+}
+
+// Copy a rectangle of pixels to another place on the screen. Each line goes
+// through a line buffer so that overlapping lines are handled, and lines are
+// copied bottom up when the destination is lower than the source.
+void copy_rect_pixels(
+    unsigned int src_x,
+    unsigned char src_y,
+    unsigned int width,
+    unsigned int height,
+    unsigned int dst_x,
+    unsigned char dst_y
+) {
+    char step;
+
+    if(width == 0 || height == 0) return;
+
+    step = 1;
+    if(dst_y > src_y) {
+        src_y += height - 1;
+        dst_y += height - 1;
+        step = -1;
+    }
+
+    for(; height != 0; height--) {
+        read_pixels(src_x, src_y, width);
+        write_pixels(dst_x, dst_y, width);
+
+        src_y += step;
+        dst_y += step;
+    }
+}
+
+// Copy a rectangle of character cells into a buffer of width * height * 8
+// bytes. A row of cells is contiguous, so each row is a single memcpy.
+void save_rect(
+    unsigned char col,
+    unsigned char row,
+    unsigned char width,
+    unsigned char height,
+    unsigned char *buffer
+) {
+    unsigned int size;
+
+    size = width * 8;
+    for(; height != 0; height--) {
+        memcpy(
+            buffer,
+            (unsigned char *)(video.line_starts[row << 3]) + col * 8,
+            size
+        );
+        buffer += size;
+        row++;
+    }
+}
+
+// Copy back a rectangle of character cells saved by save_rect().
+void restore_rect(
+    unsigned char col,
+    unsigned char row,
+    unsigned char width,
+    unsigned char height,
+    unsigned char *buffer
+) {
+    unsigned int size;
+
+    size = width * 8;
+    for(; height != 0; height--) {
+        memcpy(
+            (unsigned char *)(video.line_starts[row << 3]) + col * 8,
+            buffer,
+            size
+        );
+        buffer += size;
+        row++;
+    }
+}
+
+// Stack of saved rectangles, for nested pop-up windows and menus. Each entry
+// holds the cells followed by 4 bytes giving col, row, width and height.
+static struct {
+    unsigned char *bottom;      // First byte of the stack memory
+    unsigned char *top;         // Next free byte
+    unsigned char *end;         // Byte following the stack memory
+} saves = { NULL, NULL, NULL };
+
+// Give the memory used by push_rect() and pop_rect().
+void init_save_stack(unsigned char *buffer, unsigned int size) {
+    saves.bottom = buffer;
+    saves.top = buffer;
+    saves.end = buffer + size;
+}
+
+// Save a rectangle of character cells on the stack before it gets covered.
+// Returns 0 if there is not enough memory left, 1 otherwise.
+unsigned char push_rect(
+    unsigned char col,
+    unsigned char row,
+    unsigned char width,
+    unsigned char height
+) {
+    unsigned int size;
+
+    size = width * height * 8;
+    if(saves.end - saves.top < size + 4) return 0;
+
+    save_rect(col, row, width, height, saves.top);
+    saves.top += size;
+    *saves.top++ = col;
+    *saves.top++ = row;
+    *saves.top++ = width;
+    *saves.top++ = height;
+
+    return 1;
+}
+
+// Restore the rectangle saved by the last push_rect() and remove it from the
+// stack. Returns 0 if the stack is empty, 1 otherwise.
+unsigned char pop_rect() {
+    unsigned char col;
+    unsigned char row;
+    unsigned char width;
+    unsigned char height;
+
+    if(saves.top == saves.bottom) return 0;
+
+    height = *--saves.top;
+    width = *--saves.top;
+    row = *--saves.top;
+    col = *--saves.top;
+    saves.top -= width * height * 8;
+
+    restore_rect(col, row, width, height, saves.top);
+
+    return 1;
+}
+
+// Offset from the end of a column to the start of the next column processed
+// by hscroll_left_pixel() and hscroll_right_pixel().
+static int hscroll_step;
+
+// Shift the lines of a region of cell columns one pixel to the left. The
+// pixel leaving a column enters the next one through the carry flag. address
+// points to the first line of the rightmost column, hscroll_step moves from
+// the end of a column to the start of the previous one.
+void hscroll_left_pixel(
+    unsigned char *address,
+    unsigned char lines,
+    unsigned char columns
+) {
+#asm
+    ; address +6, lines +4, columns +2
+    ld hl, 2
+    add hl, sp
+    ld d, (hl) ; columns
+    inc hl
+    inc hl
+    ld e, (hl) ; lines
+    inc hl
+    inc hl
+    ld a, (hl) ; address
+    inc hl
+    ld h, (hl)
+    ld l, a
+
+    ; The carries of up to 8 lines are kept in c. c and the carry flag are
+    ; rotated 9 times per column so that they line up for the next column.
+    ld a, 9
+    sub e
+    ld c, 0
+
+.forloop_hsl
+    rr c
+    ld b, e
+.forloop_hsl_line
+    rl (hl)
+    rr c
+    inc hl
+    djnz forloop_hsl_line
+
+    ld b, a
+    jr padtest_hsl
+.padloop_hsl
+    rr c
+.padtest_hsl
+    djnz padloop_hsl
+
+    ; Go to the previous column
+    push de
+    ld de, (_hscroll_step)
+    add hl, de
+    pop de
+
+    dec d
+    jp nz, forloop_hsl
+    ret
+#endasm
+}
+
+// Shift the lines of a region of cell columns one pixel to the right. The
+// pixel leaving a column enters the next one through the carry flag. address
+// points to the first line of the leftmost column, hscroll_step moves from
+// the end of a column to the start of the following one.
+void hscroll_right_pixel(
+    unsigned char *address,
+    unsigned char lines,
+    unsigned char columns
+) {
+#asm
+    ; address +6, lines +4, columns +2
+    ld hl, 2
+    add hl, sp
+    ld d, (hl) ; columns
+    inc hl
+    inc hl
+    ld e, (hl) ; lines
+    inc hl
+    inc hl
+    ld a, (hl) ; address
+    inc hl
+    ld h, (hl)
+    ld l, a
+
+    ; The carries of up to 8 lines are kept in c. c and the carry flag are
+    ; rotated 9 times per column so that they line up for the next column.
+    ld a, 9
+    sub e
+    ld c, 0
+
+.forloop_hsr
+    rr c
+    ld b, e
+.forloop_hsr_line
+    rr (hl)
+    rr c
+    inc hl
+    djnz forloop_hsr_line
+
+    ld b, a
+    jr padtest_hsr
+.padloop_hsr
+    rr c
+.padtest_hsr
+    djnz padloop_hsr
+
+    ; Go to the following column
+    push de
+    ld de, (_hscroll_step)
+    add hl, de
+    pop de
+
+    dec d
+    jp nz, forloop_hsr
+    ret
+#endasm
+}
+
+// Move the lines of a region of cell columns by whole cells. address points to
+// the first line of the leftmost column.
+static void hscroll_cells(
+    unsigned char *address,
+    unsigned char lines,
+    unsigned char columns,
+    unsigned char cells,
+    unsigned char to_left
+) {
+    unsigned char kept;
+    unsigned char i;
+    unsigned char j;
+    unsigned char *line;
+
+    if(cells > columns) cells = columns;
+    kept = columns - cells;
+
+    // Complete cells are contiguous, move them all at once
+    if(lines == 8) {
+        if(to_left) {
+            memmove(address, address + cells * 8, kept * 8);
+            memset(address + kept * 8, 0, cells * 8);
+        } else {
+            memmove(address + cells * 8, address, kept * 8);
+            memset(address, 0, cells * 8);
+        }
+        return;
+    }
+
+    for(i = 0; i != lines; i++) {
+        line = address + i;
+        if(to_left) {
+            for(j = 0; j != kept; j++) line[j * 8] = line[(j + cells) * 8];
+            for(; j != columns; j++) line[j * 8] = 0;
+        } else {
+            for(j = columns; j != cells; j--) {
+                line[(j - 1) * 8] = line[(j - 1 - cells) * 8];
+            }
+            for(; j != 0; j--) line[(j - 1) * 8] = 0;
+        }
+    }
+}
+
+// Scroll a rectangle of pixels horizontally. A negative number of pixels
+// scrolls to the left, a positive one to the right. Pixels leaving the
+// rectangle are lost and the ones entering it are cleared.
+// The rectangle is processed one row of cells at a time: whole cells are moved
+// by hscroll_cells(), the remaining 1 to 7 pixels by RL/RR chains.
+void hscroll_rect(
+    unsigned int x1,
+    unsigned char y1,
+    unsigned int x2,
+    unsigned char y2,
+    int pixels
+) {
+    unsigned char start_mask;
+    unsigned char end_mask;
+    unsigned char to_left;
+    unsigned char columns;
+    unsigned char cells;
+    unsigned char bits;
+    unsigned char row;
+    unsigned char first;
+    unsigned char last;
+    unsigned char lines;
+    unsigned char i;
+    unsigned char left_edge[8];
+    unsigned char right_edge[8];
+    unsigned char *address;
+    unsigned char *right;
+
+    if(pixels == 0) return;
+    if(!clip_rect(&x1, &y1, &x2, &y2)) return;
+
+    to_left = pixels < 0;
+    if(to_left) pixels = -pixels;
+    if(pixels > SCREEN_WIDTH) pixels = SCREEN_WIDTH;
+    cells = pixels >> 3;
+    bits = pixels & 7;
+
+    start_mask = horz_start_masks[(unsigned char)x1 & 7];
+    end_mask = horz_end_masks[(unsigned char)x2 & 7];
+    columns = (x2 >> 3) - (x1 >> 3) + 1;
+    if(columns == 1) {
+        start_mask &= end_mask;
+        end_mask = start_mask;
+    }
+
+    for(row = y1 >> 3; row <= (y2 >> 3); row++) {
+        first = (row == (y1 >> 3)) ? y1 & 7 : 0;
+        last = (row == (y2 >> 3)) ? y2 & 7 : 7;
+        lines = last - first + 1;
+
+        address = (unsigned char *)(video.line_starts[(row << 3) + first])
+                + (x1 & 0xfff8);
+        right = address + (columns - 1) * 8;
+
+        // Set aside the pixels sharing a byte with the rectangle
+        for(i = 0; i != lines; i++) {
+            left_edge[i] = address[i] & ~start_mask;
+            address[i] &= start_mask;
+            right_edge[i] = right[i] & ~end_mask;
+            right[i] &= end_mask;
+        }
+
+        if(cells != 0) {
+            hscroll_cells(address, lines, columns, cells, to_left);
+        }
+
+        if(cells < columns) {
+            for(i = 0; i != bits; i++) {
+                if(to_left) {
+                    hscroll_step = -8 - lines;
+                    hscroll_left_pixel(right, lines, columns);
+                } else {
+                    hscroll_step = 8 - lines;
+                    hscroll_right_pixel(address, lines, columns);
+                }
+            }
+        }
+
+        // Right first, it is the same byte as the left one on 1 column
+        for(i = 0; i != lines; i++) {
+            right[i] = (right[i] & end_mask) | right_edge[i];
+            address[i] = (address[i] & start_mask) | left_edge[i];
+        }
+    }
+}
+
+// Cohen-Sutherland outcodes
+#define OUT_LEFT 1
+#define OUT_RIGHT 2
+#define OUT_TOP 4
+#define OUT_BOTTOM 8
+
+// Returns where a point lies around the viewport, widened by one pixel so
+// that rounding errors never reject a line whose pixels touch the viewport.
+static unsigned char outcode(int x, int y) {
+    unsigned char code;
+
+    code = 0;
+    if(x < (int)video.clip_left - 1) code = OUT_LEFT;
+    else if(x > (int)video.clip_right + 1) code = OUT_RIGHT;
+    if(y < video.clip_top - 1) code |= OUT_TOP;
+    else if(y > video.clip_bottom + 1) code |= OUT_BOTTOM;
+
+    return code;
+}
+
+// Number of minor axis steps a line has taken after k major axis steps, with
+// Bresenham's algorithm starting its error at major / 2.
+static int minor_steps(int k, int major, int minor) {
+    long n;
+
+    n = (long)k * minor - (major >> 1);
+    if(n <= 0) return 0;
+    return (n + major - 1) / major;
+}
+
+// Draw a line between any two points, clipped to the viewport. The
+// Cohen-Sutherland algorithm rejects lines outside of the viewport and finds
+// the visible part of the others. The Bresenham state at the first visible
+// pixel is then computed directly, so the pixels drawn are exactly those of
+// the whole line, and only the visible part is walked.
+void line(unsigned int x1, unsigned char y1, unsigned int x2, unsigned char y2) {
+    int ax;
+    int ay;
+    int bx;
+    int by;
+    int x;
+    int y;
+    int dx;
+    int dy;
+    int first;
+    int last;
+    int k;
+    int error;
+    unsigned char code;
+    unsigned char code_a;
+    unsigned char code_b;
+    unsigned char mask;
+    unsigned int offset;
+    signed char step;
+
+    STAT_CALL(STAT_LINE);
+
+    ax = x1;
+    ay = y1;
+    bx = x2;
+    by = y2;
+    code_a = outcode(ax, ay);
+    code_b = outcode(bx, by);
+
+    // Move the outside ends onto the viewport edges until both are inside
+    // (accept) or both are beyond the same edge (reject)
+    while(code_a | code_b) {
+        if(code_a & code_b) return;
+
+        code = code_a ? code_a : code_b;
+        if(code & OUT_TOP) {
+            y = video.clip_top - 1;
+            x = ax + (long)(bx - ax) * (y - ay) / (by - ay);
+        } else if(code & OUT_BOTTOM) {
+            y = video.clip_bottom + 1;
+            x = ax + (long)(bx - ax) * (y - ay) / (by - ay);
+        } else if(code & OUT_LEFT) {
+            x = (int)video.clip_left - 1;
+            y = ay + (long)(by - ay) * (x - ax) / (bx - ax);
+        } else {
+            x = video.clip_right + 1;
+            y = ay + (long)(by - ay) * (x - ax) / (bx - ax);
+        }
+
+        if(code == code_a) {
+            ax = x;
+            ay = y;
+            code_a = outcode(ax, ay);
+        } else {
+            bx = x;
+            by = y;
+            code_b = outcode(bx, by);
+        }
+    }
+
+    dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    dy = y2 > y1 ? y2 - y1 : y1 - y2;
+
+    if(dx >= dy) {
+        // One pixel per column, from left to right
+        if(x1 > x2) {
+            x = x1; x1 = x2; x2 = x;
+            y = y1; y1 = y2; y2 = y;
+        }
+        step = y2 < y1 ? -1 : 1;
+
+        // Visible columns, rounding errors of the clipping being corrected
+        first = (ax < bx ? ax : bx) - x1;
+        last = (ax < bx ? bx : ax) - x1;
+        if(x1 + first < video.clip_left) first = video.clip_left - x1;
+        if(x1 + last > video.clip_right) last = video.clip_right - x1;
+        while(first > 0 && x1 + first > video.clip_left) {
+            y = y1 + step * minor_steps(first - 1, dx, dy);
+            if(y < video.clip_top || y > video.clip_bottom) break;
+            first--;
+        }
+        while(last < dx && x1 + last < video.clip_right) {
+            y = y1 + step * minor_steps(last + 1, dx, dy);
+            if(y < video.clip_top || y > video.clip_bottom) break;
+            last++;
+        }
+        for(; first <= last; first++) {
+            y = y1 + step * minor_steps(first, dx, dy);
+            if(y >= video.clip_top && y <= video.clip_bottom) break;
+        }
+        for(; last >= first; last--) {
+            y = y1 + step * minor_steps(last, dx, dy);
+            if(y >= video.clip_top && y <= video.clip_bottom) break;
+        }
+
+        // No pixel of the segment falls inside the viewport
+        if(first > last) return;
+
+        k = minor_steps(first, dx, dy);
+        y = y1 + step * k;
+        error = (dx >> 1) - (long)first * dy + (long)k * dx;
+        x = x1 + first;
+        mask = vertical_masks[x & 7];
+        offset = x & 0xfff8;
+        STAT_DRAW(STAT_LINE, last - first + 1, last - first + 1);
+
+        for(k = first; k <= last; k++) {
+            *((unsigned char *)(video.line_starts[y]) + offset) |= mask;
+            error -= dy;
+            if(error < 0) {
+                y += step;
+                error += dx;
+            }
+
+            mask >>= 1;
+            if(mask == 0) {
+                mask = 0x80;
+                offset += 8;
+            }
+        }
+    } else {
+        // One pixel per line, from top to bottom
+        if(y1 > y2) {
+            x = x1; x1 = x2; x2 = x;
+            y = y1; y1 = y2; y2 = y;
+        }
+        step = x2 < x1 ? -1 : 1;
+
+        // Visible lines, rounding errors of the clipping being corrected
+        first = (ay < by ? ay : by) - y1;
+        last = (ay < by ? by : ay) - y1;
+        if(y1 + first < video.clip_top) first = video.clip_top - y1;
+        if(y1 + last > video.clip_bottom) last = video.clip_bottom - y1;
+        while(first > 0 && y1 + first > video.clip_top) {
+            x = x1 + step * minor_steps(first - 1, dy, dx);
+            if(x < (int)video.clip_left || x > (int)video.clip_right) break;
+            first--;
+        }
+        while(last < dy && y1 + last < video.clip_bottom) {
+            x = x1 + step * minor_steps(last + 1, dy, dx);
+            if(x < (int)video.clip_left || x > (int)video.clip_right) break;
+            last++;
+        }
+        for(; first <= last; first++) {
+            x = x1 + step * minor_steps(first, dy, dx);
+            if(x >= (int)video.clip_left && x <= (int)video.clip_right) break;
+        }
+        for(; last >= first; last--) {
+            x = x1 + step * minor_steps(last, dy, dx);
+            if(x >= (int)video.clip_left && x <= (int)video.clip_right) break;
+        }
+
+        // No pixel of the segment falls inside the viewport
+        if(first > last) return;
+
+        k = minor_steps(first, dy, dx);
+        x = x1 + step * k;
+        error = (dy >> 1) - (long)first * dx + (long)k * dy;
+        y = y1 + first;
+        mask = vertical_masks[x & 7];
+        offset = x & 0xfff8;
+        STAT_DRAW(STAT_LINE, last - first + 1, last - first + 1);
+
+        for(k = first; k <= last; k++) {
+            *((unsigned char *)(video.line_starts[y]) + offset) |= mask;
+            y++;
+            error -= dx;
+            if(error < 0) {
+                error += dy;
+                if(step > 0) {
+                    mask >>= 1;
+                    if(mask == 0) {
+                        mask = 0x80;
+                        offset += 8;
+                    }
+                } else {
+                    mask <<= 1;
+                    if(mask == 0) {
+                        mask = 0x01;
+                        offset -= 8;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Draw the outline of a rectangle. The four sides are clipped here at once
+// and drawn by the span routines, each corner pixel only once. The sides
+// drawn are counted as the lines of the same direction.
 void frame(unsigned int tx, unsigned char ty, unsigned int bx, unsigned char by) {
-    vertical_line(tx, ty, by);
-    vertical_line(bx, ty, by);
-    horizontal_line(tx, bx, ty);
-    horizontal_line(tx, bx, by);
+    unsigned int x1;
+    unsigned int x2;
+    unsigned char y1;
+    unsigned char y2;
+
+    // Horizontal sides
+    x1 = tx < video.clip_left ? video.clip_left : tx;
+    x2 = bx > video.clip_right ? video.clip_right : bx;
+    if(x1 <= x2) {
+        if(ty >= video.clip_top && ty <= video.clip_bottom) {
+            STAT_CALL(STAT_HORIZONTAL_LINE);
+            STAT_DRAW(STAT_HORIZONTAL_LINE, x2 - x1 + 1, (x2 >> 3) - (x1 >> 3) + 1);
+            horizontal_span(x1, x2, ty);
+        }
+
+        if(by != ty && by >= video.clip_top && by <= video.clip_bottom) {
+            STAT_CALL(STAT_HORIZONTAL_LINE);
+            STAT_DRAW(STAT_HORIZONTAL_LINE, x2 - x1 + 1, (x2 >> 3) - (x1 >> 3) + 1);
+            horizontal_span(x1, x2, by);
+        }
+    }
+
+    // Vertical sides, between the horizontal ones
+    if(by - ty < 2) return;
+    y1 = ty + 1 < video.clip_top ? video.clip_top : ty + 1;
+    y2 = by - 1 > video.clip_bottom ? video.clip_bottom : by - 1;
+    if(y1 > y2) return;
+
+    if(tx >= video.clip_left && tx <= video.clip_right) {
+        STAT_CALL(STAT_VERTICAL_LINE);
+        STAT_DRAW(STAT_VERTICAL_LINE, y2 - y1 + 1, y2 - y1 + 1);
+        vertical_span(tx, y1, y2);
+    }
+
+    if(bx != tx && bx >= video.clip_left && bx <= video.clip_right) {
+        STAT_CALL(STAT_VERTICAL_LINE);
+        STAT_DRAW(STAT_VERTICAL_LINE, y2 - y1 + 1, y2 - y1 + 1);
+        vertical_span(bx, y1, y2);
+    }
+}
+
+// Allocate a canvas of columns x rows cells from the arena. Canvases have
+// the cell layout of the screen and are at most as large.
+// Returns 0 if there is not enough memory, 1 otherwise.
+unsigned char init_canvas(struct canvas *canvas, unsigned char columns, unsigned char rows) {
+    canvas->columns = columns;
+    canvas->rows = rows;
+    canvas->stride = columns * 8;
+    canvas->buffer = arena_alloc(rows * canvas->stride);
+    canvas->line_starts = arena_alloc(rows * 8 * sizeof(unsigned int));
+    if(canvas->buffer == NULL || canvas->line_starts == NULL) return 0;
+
+    init_line_starts(canvas->line_starts, canvas->buffer, rows, canvas->stride);
+    return 1;
+}
+
+// Make print, lines, fills, plots and the other drawing functions draw into
+// a canvas, or into the screen for NULL. The viewport becomes the whole target
+// and the cursor goes back to its top left corner.
+void set_target(struct canvas *canvas) {
+    unsigned char i;
+
+    if(canvas == NULL) canvas = &screen_canvas;
+    target = canvas;
+
+    video.screen = canvas->buffer;
+    video.line_starts = canvas->line_starts;
+    video.stride = canvas->stride;
+    video.columns = canvas->columns;
+    video.rows = canvas->rows;
+
+    for(i = 0; i != 8; i++) dh_offset[i + 8] = canvas->stride + i;
+
+    set_viewport(0, 0, 0xffff, 0xff);
+    locate(0, 0);
+}
+
+// Returns the canvas being drawn to, the screen unless set_target() chose
+// another one.
+struct canvas *get_target() {
+    return target;
+}
+
+// Copy a canvas to the screen, its top left corner at col, row. The parts
+// falling outside of the screen are not copied. Rows of cells are contiguous
+// in both, so each one is a single block copy.
+void blit_canvas(struct canvas *canvas, unsigned char col, unsigned char row) {
+    unsigned char r;
+    unsigned char rows;
+    unsigned int size;
+    unsigned char *source;
+
+    if(col >= screen_canvas.columns || row >= screen_canvas.rows) return;
+
+    size = canvas->stride;
+    if(col + canvas->columns > screen_canvas.columns) {
+        size = (screen_canvas.columns - col) * 8;
+    }
+
+    rows = canvas->rows;
+    if(row + rows > screen_canvas.rows) rows = screen_canvas.rows - row;
+
+    source = canvas->buffer;
+    for(r = 0; r != rows; r++) {
+        memcpy(
+            (unsigned char *)(screen_canvas.line_starts[(row + r) << 3]) + col * 8,
+            source,
+            size
+        );
+        source += canvas->stride;
+    }
 }
 
 // Initializes everything!
 void init_video_ram(unsigned int stack_size) {
+    STAT_CALL(STAT_INIT);
     alloc_screen_memory(stack_size);
-    locate(0, 0);
+    init_roller_ram();
+    set_target(NULL);
     set_size(SIZE_NORMAL);
     set_brightness(BRIGHTNESS_FULL);
+    set_pattern(grey_pattern(GREY_LEVELS - 1));
+    set_background(NULL);
+    set_attributes(ATTR_NONE);
     set_font(stdfont);
-    init_roller_ram();
     clear_screen();
     set_roller_ram_address();
 }
+
+#ifdef VIDEO_STATS
+// Returns the counters of the instrumented build, STAT_COUNT of them indexed
+// by the STAT_ constants.
+struct video_counter *video_stats() {
+    return stats;
+}
+
+// Set all the counters back to 0.
+void video_stats_reset() {
+    memset(stats, 0, sizeof(stats));
+}
+
+// Print the counters, one line per primitive.
+void video_stats_print() {
+    unsigned char i;
+
+    printf("%-20s %8s %10s %10s\n", "primitive", "calls", "units", "bytes");
+    for(i = 0; i != STAT_COUNT; i++) {
+        printf(
+            "%-20s %8lu %10lu %10lu\n",
+            stat_names[i], stats[i].calls, stats[i].units, stats[i].bytes
+        );
+    }
+}
+
+// Called before and after each print() of the instrumented build, and
+// available to bracket any other code. They do nothing, their addresses
+// (from the map file) serve as start and end points for the cycle counts of
+// the z88dk ticks simulator.
+void video_sample_begin() {
+}
+
+void video_sample_end() {
+}
+#endif
@@ -20,16 +20,105 @@
 #define BRIGHTNESS_FULL 0
 #define BRIGHTNESS_HALF 1
 
+#define GREY_LEVELS 17
+
+#define PARAGRAPH_LEFT 0
+#define PARAGRAPH_JUSTIFY 1
+
+#define ATTR_NONE 0
+#define ATTR_INVERSE 1
+#define ATTR_UNDERLINE 2
+#define ATTR_BOLD 4
+#define ATTR_ITALIC 8
+
+// Counters of the build compiled with VIDEO_STATS defined
+#define STAT_PRINT_NORMAL 0
+#define STAT_PRINT_DOUBLE_WIDTH 1
+#define STAT_PRINT_DOUBLE_HEIGHT 2
+#define STAT_PRINT_DOUBLE 3
+#define STAT_VERTICAL_LINE 4
+#define STAT_HORIZONTAL_LINE 5
+#define STAT_LINE 6
+#define STAT_FILL 7
+#define STAT_CLEAR 8
+#define STAT_INIT 9
+#define STAT_COUNT 10
+
+// Calls of a primitive, units drawn (characters or pixels) and screen bytes
+// written
+struct video_counter {
+    unsigned long calls;
+    unsigned long units;
+    unsigned long bytes;
+};
+
+// A pixel position for plot_many()
+struct point {
+    unsigned int x;
+    unsigned char y;
+};
+
+// A drawing surface with the cell layout of the screen, for set_target()
+struct canvas {
+    unsigned char *buffer;      // Rows of cells of 8 bytes
+    unsigned int *line_starts;  // Address of each pixel line
+    unsigned int stride;        // Bytes from a row of cells to the next
+    unsigned char columns;      // Width in cells, at most 90
+    unsigned char rows;         // Height in cells, at most 32
+};
+
 extern void init_video_ram(unsigned int stack_size);
 extern void set_font(unsigned char *font);
 extern void set_size(unsigned char size);
 extern void set_brightness(unsigned char brightness);
 extern void restore_video_ram();
+extern unsigned char *get_screen();
+extern void roller_reset();
+extern void roller_map(unsigned char y, unsigned char source);
+extern void roller_zoom(unsigned char y1, unsigned char y2, unsigned char source, unsigned char factor);
+extern void roller_mirror(unsigned char y1, unsigned char y2, unsigned char source);
+extern void roller_repeat(unsigned char y1, unsigned char y2, unsigned char source);
+extern unsigned char *cell_address(unsigned char col, unsigned char row);
 extern void clear_screen();
 extern void locate(unsigned char col, unsigned char row);
 extern void print(const unsigned char *string);
+extern void print_utf8(const unsigned char *string);
+extern unsigned char print_paragraph(const unsigned char *text, unsigned char col, unsigned char row, unsigned char width, unsigned char flags);
+extern void set_viewport(unsigned int x1, unsigned char y1, unsigned int x2, unsigned char y2);
 extern void vertical_line(unsigned int x, unsigned char y1, unsigned char y2);
 extern void horizontal_line(unsigned int x1, unsigned int x2, unsigned char y);
+extern void line(unsigned int x1, unsigned char y1, unsigned int x2, unsigned char y2);
+extern void plot(unsigned int x, unsigned char y);
+extern void unplot(unsigned int x, unsigned char y);
+extern unsigned char point(unsigned int x, unsigned char y);
+extern void plot_many(struct point *points, unsigned int n);
+extern unsigned char *grey_pattern(unsigned char level);
+extern void set_pattern(unsigned char *pattern);
+extern void set_background(unsigned char *pattern);
+extern void set_attributes(unsigned char attributes);
+extern unsigned char get_attributes();
+extern void fill_rect(unsigned int x1, unsigned char y1, unsigned int x2, unsigned char y2);
+extern void pattern_span(unsigned int x1, unsigned int x2, unsigned char y);
+extern void copy_rect(unsigned char src_col, unsigned char src_row, unsigned char width, unsigned char height, unsigned char dst_col, unsigned char dst_row);
+extern void copy_rect_pixels(unsigned int src_x, unsigned char src_y, unsigned int width, unsigned int height, unsigned int dst_x, unsigned char dst_y);
+extern void save_rect(unsigned char col, unsigned char row, unsigned char width, unsigned char height, unsigned char *buffer);
+extern void restore_rect(unsigned char col, unsigned char row, unsigned char width, unsigned char height, unsigned char *buffer);
+extern void init_save_stack(unsigned char *buffer, unsigned int size);
+extern unsigned char push_rect(unsigned char col, unsigned char row, unsigned char width, unsigned char height);
+extern unsigned char pop_rect();
+extern void hscroll_rect(unsigned int x1, unsigned char y1, unsigned int x2, unsigned char y2, int pixels);
+extern unsigned char init_canvas(struct canvas *canvas, unsigned char columns, unsigned char rows);
+extern void set_target(struct canvas *canvas);
+extern struct canvas *get_target();
+extern void blit_canvas(struct canvas *canvas, unsigned char col, unsigned char row);
 extern void frame(unsigned int tx, unsigned char ty, unsigned int bx, unsigned char by);
 
+#ifdef VIDEO_STATS
+extern struct video_counter *video_stats();
+extern void video_stats_reset();
+extern void video_stats_print();
+extern void video_sample_begin();
+extern void video_sample_end();
+#endif
+
 #endif